@@ -0,0 +1,77 @@
+#pragma once
+#include "Arduino.h"
+#include "SensorTrace.h"  // Input hooks for trace record/replay
+
+// One analog input with its own sampling setup: ADC resolution, the ADC's
+// hardware averaging, and decimated oversampling (4^n conversions summed and
+// shifted right by n for n extra bits). The Teensy ADC settings are global,
+// so each read re-applies them only if another channel changed them.
+// Counts run 0..getMaximum(); code written for the original 10-bit encoders
+// converts its thresholds with scale().
+
+#define ADC_REFERENCE_BITS 10 // Resolution the controller's count constants were written for
+#define ADC_MAX_BITS       16 // Counts must fit in uint16_t
+#define ADC_MAX_OVERSAMPLE 6  // Extra bits from oversampling, 4^6 conversions per read already takes milliseconds
+
+class AnalogChannel{
+  private:
+    uint8_t pin;
+    uint8_t resolution;     // ADC conversion bits (8, 10 or 12)
+    uint8_t averaging;      // Hardware averaging (1, 4, 8, 16 or 32 conversions)
+    uint8_t oversampleBits; // Extra bits from decimated oversampling
+    static uint8_t appliedResolution;
+    static uint8_t appliedAveraging;
+  public:
+    AnalogChannel(uint8_t analogPin);
+    void configure(uint8_t bits, uint8_t hwAveraging, uint8_t extraBits);
+    uint16_t read();
+    uint8_t getPin() {return pin;}
+    uint8_t getBits() {return resolution+oversampleBits;}
+    uint16_t getMaximum() {return (uint16_t)((1UL<<getBits())-1);}
+    uint16_t getCenter() {return (uint16_t)(1UL<<(getBits()-1));}
+    uint32_t getConversions() {return (uint32_t)averaging<<(2*oversampleBits);} // ADC conversions per read()
+    int32_t scale(int32_t referenceCounts); // 10-bit counts to this channel's counts
+};//end of AnalogChannel class
+
+uint8_t AnalogChannel::appliedResolution = 0; // Unknown until the first read applies them
+uint8_t AnalogChannel::appliedAveraging = 0;
+
+AnalogChannel::AnalogChannel(uint8_t analogPin) {
+  pin = analogPin;
+  resolution = 10;
+  averaging = 4;
+  oversampleBits = 0;
+} //end of constructor
+
+void AnalogChannel::configure(uint8_t bits, uint8_t hwAveraging, uint8_t extraBits){
+  resolution = bits>12 ? 12 : (bits<8 ? 8 : bits);
+  if(extraBits>ADC_MAX_OVERSAMPLE)
+    extraBits = ADC_MAX_OVERSAMPLE;
+  if(resolution+extraBits>ADC_MAX_BITS)
+    extraBits = ADC_MAX_BITS-resolution;
+  oversampleBits = extraBits;
+  averaging = hwAveraging<1 ? 1 : (hwAveraging>32 ? 32 : hwAveraging);
+}
+
+uint16_t AnalogChannel::read(){
+  if(appliedResolution != resolution){
+    analogReadResolution(resolution);
+    appliedResolution = resolution;
+  }
+  if(appliedAveraging != averaging){
+    analogReadAveraging(averaging);
+    appliedAveraging = averaging;
+  }
+  if(oversampleBits == 0)
+    return traceAnalogRead(pin);
+  uint32_t sum = 0;
+  uint32_t samples = 1UL<<(2*oversampleBits);
+  for(uint32_t i=0;i<samples;i++)
+    sum += traceAnalogRead(pin);
+  return sum>>oversampleBits;
+}
+
+int32_t AnalogChannel::scale(int32_t referenceCounts){
+  int shift = getBits()-ADC_REFERENCE_BITS;
+  return shift>=0 ? referenceCounts<<shift : referenceCounts>>-shift;
+}
@@ -1,9 +1,11 @@
-//#pragma once
+#pragma once
 #include "teensystep4.h"  // Library for fast, asynchronous stepper motor control on Teensy4
 using namespace TS4;      // Namespace for TeensyStep4
 #include "Arduino.h"   
 #include <Bounce2.h>      // Library for debouncing inputs
 #include "RobotAxis.h"
+#include "SensorTrace.h"  // Input hooks for trace record/replay
+#include "AnalogInput.h"  // Encoder/stick sampling setup
 //#include "ArduPID.h"
 
 enum axis {X,Y,Z};
@@ -27,14 +29,16 @@ class JoyStick{
     bool zInvert;
     //uint16_t Xpos;             // For reading/calculating Joystick X input [0-1023]
                               // ****** shouldn't need, call getPosition() when needed
-    uint16_t home[3];            // Home value for zeroing Joystick input [0-1023]
+    uint16_t home[3];            // Home value for zeroing Joystick input [0-channel maximum]
     //uint16_t Zpos;             // For reading/calculating Joystick Z input [0-1023]
     //uint16_t Zhome;            // Home value for zeroing Joystick Z input [0-1023]
-    uint8_t  Deadzone; // How far off of home does joystick need to be to activate? [0-255] <--- We will want to have one for each axis, and will want to build a calibration routine
-    Bounce buttonBounce; // Define debounce object for joystickButton
+    uint8_t  Deadzone; // How far off of home, in 10-bit counts does joystick need to be to activate? [0-255] <--- We will want to have one for each axis, and will want to build a calibration routine
+    TracedBounce buttonBounce; // Define debounce object for joystickButton
+    AnalogChannel channel[3];  // X, Y, Z inputs
   public:
     JoyStick(int pinX, int pinY, int pinZ, int buttonPin); //constructor
     void setPinModes();    
+    void configure(uint8_t bits, uint8_t hwAveraging, uint8_t extraBits); // Sampling for all three inputs, call setHome() after
     uint16_t getHome(axis direction);
     uint8_t getDeadzone() {return Deadzone;}
     uint16_t getPosition(axis direction);       
@@ -46,13 +50,16 @@ class JoyStick{
     void rotate(axis direction, RobotAxis& robAxis, uint16_t speed);    //use an enumerated type for direction
 };//end of Joystick class
 
-JoyStick::JoyStick(int pinX, int pinY, int pinZ, int buttonPin) {
+JoyStick::JoyStick(int pinX, int pinY, int pinZ, int buttonPin) : channel{AnalogChannel(pinX),AnalogChannel(pinY),AnalogChannel(pinZ)} {
       teachPendantPinX = pinX;
       teachPendantPinY = pinY;
       teachPendantPinZ = pinZ;
       buttonTeachPendantPin = buttonPin;      
+      xInvert = false;
+      yInvert = false;
+      zInvert = false;
       Deadzone = 50;     
-      buttonBounce = Bounce();    
+      buttonBounce = TracedBounce();    
 } //end of constructor
 
 void JoyStick::setPinModes() { pinMode(teachPendantPinX,INPUT); //**** is INPUT an enumerated type? <-- Probably, and it's also probably defined wherever pinMode is...
@@ -61,6 +68,11 @@ void JoyStick::setPinModes() { pinMode(teachPendantPinX,INPUT); //**** is INPUT
                         // pinMode(JOYSTICK_BUTTON,INPUT); //Joystick Button
 } //end of setPinModes    
 
+void JoyStick::configure(uint8_t bits, uint8_t hwAveraging, uint8_t extraBits){
+  for(int i=0;i<3;i++)
+    channel[i].configure(bits,hwAveraging,extraBits);
+}
+
 void JoyStick::getXYZ(uint16_t &x, uint16_t &y, uint16_t &z){
           x = getPosition(axis::X);
           y = getPosition(axis::Y);
@@ -92,9 +104,9 @@ bool JoyStick::invertZ(){
 
 uint16_t JoyStick::getPosition(axis direction){
   switch(direction){
-    case X: return analogRead(teachPendantPinX); break;
-    case Y: return analogRead(teachPendantPinY); break;
-    case Z: return analogRead(teachPendantPinZ); break;
+    case X: return channel[0].read(); break;
+    case Y: return channel[1].read(); break;
+    case Z: return channel[2].read(); break;
   }
 return 0;  //this would be an error
 }
@@ -115,12 +127,14 @@ void JoyStick::rotate(axis direction, RobotAxis& robAxis, uint16_t speed){
                         currentHome = home[2];
                         invert = zInvert; break;                                       
   }
-      if(abs(position-currentHome)>Deadzone){ //Is movement greater than deadzone?
+      AnalogChannel& input = channel[direction];
+      if(abs(position-currentHome)>input.scale(Deadzone)){ //Is movement greater than deadzone?
         double offsetVal;
+        double fullScale = input.getCenter(); //Half the stick's range
         if(position<currentHome){//Stick Pushed Right, Rotate Right
-          offsetVal = -(position-currentHome)/512.0;
+          offsetVal = -(position-currentHome)/fullScale;
         }else{//Stick Pushed Left, Rotate Left
-          offsetVal =(currentHome-position)/512.0;
+          offsetVal =(currentHome-position)/fullScale;
         }
         if(invert){
             offsetVal = offsetVal * -1;
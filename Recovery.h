@@ -0,0 +1,176 @@
+#pragma once
+#include "Arduino.h"
+#include "RobotAxis.h"
+using namespace TS4;      // Namespace for TeensyStep4
+
+// Fast recovery from an unplanned reset. The scheduler feeds a hardware watchdog
+// and periodically writes a small CRC'd snapshot (joint positions, which axes
+// were calibrated, active program) to RAM2, which the Teensy 4 startup code
+// does not clear. After a reset, restore() checks the snapshot against the
+// encoders and re-arms every axis that has not moved instead of re-homing.
+// A power-on leaves random data in RAM2, the CRC rejects it.
+// The snapshot sits at a fixed address at the top of RAM2, directly below the
+// 128 bytes the Teensy core keeps its CrashReport in for the same reason. The
+// bottom of RAM2 holds DMAMEM buffers, and the boot ROM uses the start of the
+// OCRAM during a reset, so the snapshot is kept away from both.
+
+#define SNAPSHOT_MAGIC     0x4B52534E // "NSRK"
+#define SNAPSHOT_AXES      5
+#define SNAPSHOT_INTERVAL  20   // Snapshot period [ms]
+#define SNAPSHOT_TOLERANCE 4    // Encoder travel (10-bit counts) an axis may move across a reset and still verify
+#define WATCHDOG_MAX_MS    2047 // RTWDOG at 32kHz with a 16 bit timeout
+#define SNAPSHOT_ADDRESS   0x2027FF00 // Top of RAM2, below CrashReport at 0x2027FF80
+
+struct StateSnapshot{
+  uint32_t magic;
+  uint32_t sequence;                 // Incremented on every save
+  uint32_t uptime;                   // millis() at save
+  uint16_t position[SNAPSHOT_AXES];  // Encoder counts
+  int32_t  steps[SNAPSHOT_AXES];     // Motor step positions
+  uint8_t  attached;                 // Bit per axis: axis present
+  uint8_t  calibrated;               // Bit per axis: calibration valid at save time
+  int8_t   program;                  // Active program index, -1 for none
+  uint8_t  resets;                   // Unplanned resets recovered from so far
+  uint32_t crc;                      // CRC-32 of everything above
+};
+
+static_assert(sizeof(StateSnapshot) <= 0x80, "StateSnapshot must fit below CrashReport");
+
+#ifdef __IMXRT1062__
+StateSnapshot& retainedSnapshot = *(StateSnapshot*)SNAPSHOT_ADDRESS; // Survives a warm reset
+#else
+StateSnapshot hostSnapshot;
+StateSnapshot& retainedSnapshot = hostSnapshot;
+#endif
+
+uint32_t crc32(const uint8_t* data, size_t length){
+  uint32_t crc = 0xFFFFFFFF;
+  for(size_t i=0;i<length;i++){
+    crc ^= data[i];
+    for(uint8_t bit=0;bit<8;bit++)
+      crc = (crc>>1) ^ (0xEDB88320 & -(crc&1));
+  }
+  return ~crc;
+}
+
+class Recovery : public Task{
+  private:
+    RobotAxis* axes[SNAPSHOT_AXES];
+    uint32_t lastSave;
+    int8_t program;
+    uint8_t resets;
+    bool recovered;
+    bool watchdogRunning;
+    uint32_t snapshotCrc(const StateSnapshot& s);
+  public:
+    Recovery();
+    void attachAxis(uint8_t index, RobotAxis& robAxis);
+    bool restore();                   // Call in setup() after the axes exist; true if state was recovered
+    void save();                      // Write a fresh snapshot now
+    void tick();                      // Feeds the watchdog, saves every SNAPSHOT_INTERVAL
+    bool run() override {tick(); return true;} // As a Scheduler task, never finishes
+    void startWatchdog(uint16_t ms);  // Reset the controller if tick() stops for this long
+    void feed();
+    void setProgram(int8_t index) {program = index;}
+    int8_t getProgram() {return program;}
+    uint8_t getResets() {return resets;}
+    bool wasRecovered() {return recovered;}
+};//end of Recovery class
+
+Recovery::Recovery() {
+  for(uint8_t i=0;i<SNAPSHOT_AXES;i++)
+    axes[i] = nullptr;
+  lastSave = 0;
+  program = -1;
+  resets = 0;
+  recovered = false;
+  watchdogRunning = false;
+} //end of constructor
+
+uint32_t Recovery::snapshotCrc(const StateSnapshot& s){
+  return crc32((const uint8_t*)&s,offsetof(StateSnapshot,crc));
+}
+
+void Recovery::attachAxis(uint8_t index, RobotAxis& robAxis){
+  if(index<SNAPSHOT_AXES)
+    axes[index] = &robAxis;
+}
+
+bool Recovery::restore(){
+  StateSnapshot s;
+  memcpy(&s,&retainedSnapshot,sizeof(s));
+  if(s.magic != SNAPSHOT_MAGIC || s.crc != snapshotCrc(s))
+    return false; //Power-on or corrupted, cold start
+  resets = s.resets+1;
+  program = s.program;
+  for(uint8_t i=0;i<SNAPSHOT_AXES;i++){
+    if(!axes[i] || !(s.attached & (1<<i))) continue;
+    if(axes[i]->restoreState(s.position[i],s.steps[i],s.calibrated & (1<<i),axes[i]->scaleCounts(SNAPSHOT_TOLERANCE)))
+      recovered = true;
+  }
+  save();
+  return recovered;
+}
+
+void Recovery::save(){
+  StateSnapshot s;
+  memset(&s,0,sizeof(s));
+  s.magic = SNAPSHOT_MAGIC;
+  s.sequence = retainedSnapshot.sequence+1;
+  s.uptime = millis();
+  for(uint8_t i=0;i<SNAPSHOT_AXES;i++){
+    if(!axes[i]) continue;
+    axes[i]->updatePosition();
+    s.position[i] = axes[i]->getEncoderPosition();
+    s.steps[i] = axes[i]->getMotorPosition();
+    s.attached |= 1<<i;
+    if(axes[i]->isCalibrated() && !axes[i]->isFaulted())
+      s.calibrated |= 1<<i;
+  }
+  s.program = program;
+  s.resets = resets;
+  s.crc = snapshotCrc(s);
+  memcpy(&retainedSnapshot,&s,sizeof(s));
+  arm_dcache_flush(&retainedSnapshot,sizeof(retainedSnapshot)); //Write back to RAM2 before any reset can hit
+  lastSave = millis();
+}
+
+void Recovery::tick(){
+  feed();
+  if(millis()-lastSave >= SNAPSHOT_INTERVAL)
+    save();
+}
+
+// RTWDOG (WDOG3) clocked from the 32kHz LPO; registers from imxrt.h
+#define RTWDOG_UNLOCK_KEY  0xD928C520
+#define RTWDOG_FEED_KEY    0xB480A602
+#define RTWDOG_CS_EN_BIT      (1<<7)
+#define RTWDOG_CS_UPDATE_BIT  (1<<5)
+#define RTWDOG_CS_CLK_LPO     (1<<8)
+#define RTWDOG_CS_RCS_BIT     (1<<10)
+#define RTWDOG_CS_ULK_BIT     (1<<11)
+#define RTWDOG_CS_CMD32EN_BIT (1<<13)
+
+void Recovery::startWatchdog(uint16_t ms){
+  if(ms>WATCHDOG_MAX_MS) ms = WATCHDOG_MAX_MS;
+#if defined(__IMXRT1062__)
+  __disable_irq();
+  RTWDOG_CNT = RTWDOG_UNLOCK_KEY;
+  while(!(RTWDOG_CS & RTWDOG_CS_ULK_BIT));
+  RTWDOG_TOVAL = ms*32;
+  RTWDOG_WIN = 0;
+  RTWDOG_CS = RTWDOG_CS_CMD32EN_BIT | RTWDOG_CS_CLK_LPO | RTWDOG_CS_EN_BIT | RTWDOG_CS_UPDATE_BIT;
+  __enable_irq();
+  while(!(RTWDOG_CS & RTWDOG_CS_RCS_BIT));
+#endif
+  watchdogRunning = true;
+}
+
+void Recovery::feed(){
+  if(!watchdogRunning) return;
+#if defined(__IMXRT1062__)
+  __disable_irq();
+  RTWDOG_CNT = RTWDOG_FEED_KEY;
+  __enable_irq();
+#endif
+}
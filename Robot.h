@@ -1,72 +1,189 @@
-#include "Arduino.h"   
-#include <Bounce2.h>      // Library for debouncing inputs 
+#pragma once
+#include "Arduino.h"
+#include <Bounce2.h>      // Library for debouncing inputs
 #include "teensystep4.h"  // Library for fast, asynchronous stepper motor control on Teensy4
 #include "RobotAxis.h"
 #include "Joystick.h"
 using namespace TS4;      // Namespace for TeensyStep4
 
+#define ROBOT_AXES 5 // Number of axes driven by the Robot controller
+
+// Bits in AxisState::flags[]
+#define AXIS_ENABLED   0x01 // Drive is allowed to run
+#define AXIS_MOVING    0x02 // Controller is commanding motion this tick
+#define AXIS_AT_TARGET 0x04 // Encoder is within tolerance of the setpoint
+
+// Per-tick (hot) axis state, one contiguous array per field so the control
+// law runs as a single branch-free pass over every axis. Pins, calibration,
+// Bounce and Stepper objects stay in RobotAxis and are only touched for I/O.
+template <uint8_t N>
+struct AxisState{
+    float   position[N];     // Encoder position this tick [counts]
+    float   lastPosition[N]; // Encoder position last tick [counts]
+    float   velocity[N];     // Encoder velocity [counts/s]
+    float   setpoint[N];     // Target encoder position [counts]
+    float   output[N];       // Normalized motor command [-1,1]
+    float   Kp[N];           // Proportional gain (copied from RobotAxis)
+    float   Ki[N];           // Integral gain [1/s]
+    float   Kd[N];           // Derivative gain, on measurement
+    float   integral[N];     // Integral term, clamped to the output range
+    float   tolerance[N];    // Error considered "at target" [counts]
+    uint8_t flags[N];        // AXIS_* bits
+
+    void clear();
+    void compute(float dt);
+};//end of AxisState struct
+
+template <uint8_t N>
+void AxisState<N>::clear(){
+  for(uint8_t i=0;i<N;i++){
+    position[i] = lastPosition[i] = velocity[i] = 0;
+    setpoint[i] = output[i] = 0;
+    Kp[i] = Ki[i] = Kd[i] = 0;
+    integral[i] = 0;
+    tolerance[i] = 0;
+    flags[i] = 0;
+  }
+}
+
+// Control law for all axes at once, PID like the ArduPID each axis was built
+// with. Written without calls or if statements so the clamps and selects can
+// be if-converted; GCC only does that, and then vectorizes the loop, with
+// -fno-trapping-math (set for the host build). dt is the tick period in seconds. The integral is held within the output range
+// (anti-windup) and cleared while the axis is disabled.
+template <uint8_t N>
+void AxisState<N>::compute(float dt){
+  const float rate = 1.0f/dt;
+  for(uint8_t i=0;i<N;i++){
+    float error = setpoint[i]-position[i];
+    velocity[i] = (position[i]-lastPosition[i])*rate;
+    lastPosition[i] = position[i];
+    float sum = integral[i] + Ki[i]*error*dt;
+    sum = sum > 1.0f ? 1.0f : (sum < -1.0f ? -1.0f : sum);
+    integral[i] = (flags[i] & AXIS_ENABLED) ? sum : 0.0f;
+    float out = Kp[i]*error + integral[i] - Kd[i]*velocity[i];
+    out = out > 1.0f ? 1.0f : (out < -1.0f ? -1.0f : out);
+    out = (flags[i] & AXIS_ENABLED) ? out : 0.0f;
+    output[i] = out;
+    flags[i] = (flags[i] & AXIS_ENABLED)
+             | ((out != 0.0f) ? AXIS_MOVING : 0)
+             | ((fabsf(error) <= tolerance[i]) ? AXIS_AT_TARGET : 0);
+  }
+}
+
 class Robot{
   private:
     enum controlMode {T1,T2,AUTO,AUTOEXT};
-    controlMode& operator++(controlMode& orig) {  //pre increment operator
-      orig = static_cast<controlMode>(orig + 1);
-      return orig;
-    }
-    controlMode operator++(controlMode& orig, int) {  //post increment operator
-    controlMode rVal = orig;
-    ++orig;
-    return rVal;}
-
-    RobotAxis axis[5];
-    int currentPose[5];
-    int targetPose[5];
+
+    RobotAxis* axes[ROBOT_AXES];     // Cold: pins, calibration, I/O objects (nullptr if not fitted)
+    AxisState<ROBOT_AXES> state;     // Hot: touched every tick
+    controlMode mode;
+    float tolerance;                 // Error considered "at target" [10-bit counts]
     bool estop;
     bool mstop;
     bool fault;
-    int faultCode
+    int faultCode;
     bool moving;
     bool calibrated;
-    Joystick pendant;
+    JoyStick& pendant;
 
   public:
-    Robot();
-    
+    Robot(JoyStick& joystick);
+
+    void attachAxis(uint8_t index, RobotAxis& robAxis);
     void enableMotors();
     void disableMotors();
 
-    void getCurrentPose();
-    void getTargetPose();
-    void setTargetPose();
-    
-
-
+    void getCurrentPose(int pose[ROBOT_AXES]);
+    void getTargetPose(int pose[ROBOT_AXES]);
+    void setTargetPose(const int pose[ROBOT_AXES]);
+    bool isMoving();
+    void tick(float dt);
 };//end of Robot class
 
-Robot::Robot() {
-
-      encoderPin = encPin;
-      endstopPin = endPin;
-      homingPin = homPin;
-      enablePin = enPin;
-      directionPin = dirPin;
-      stepPin = stpPin;
-      serialTxPin = txPin;
-      serialRxPin = rxPin;
-      Kp = p;
-      Ki = i;
-      Kd = d;
-      homingSpeed = 5000;
-      motor = Stepper(stpPin, dirPin);
-     // TS4::begin(); //Begin TeensyStep4 Service
-      homeSensor = Bounce();
-      endStop = Bounce();
+Robot::Robot(JoyStick& joystick) : pendant(joystick) {
+      for(uint8_t i=0;i<ROBOT_AXES;i++)
+        axes[i] = nullptr;
+      state.clear();
+      mode = T1;
+      tolerance = 2;
+      estop = true;
+      mstop = true;
       calibrated = false;
       moving = false;
       fault = true;
-      enabled = false;
       faultCode = 7; //Not Calibrated
-      //Check EEPROM for Hard or Soft Stop Stored Positions
-      //If valid, clear fault and change faultCode to 6 for "Unverified Calibration" 
 } //end of constructor
 
-void Robot::
\ No newline at end of file
+void Robot::attachAxis(uint8_t index, RobotAxis& robAxis){
+  if(index>=ROBOT_AXES) return;
+  double p,i,d;
+  axes[index] = &robAxis;
+  robAxis.getTunings(p,i,d);
+  robAxis.updatePosition();
+  float scale = (float)robAxis.scaleCounts(1<<ADC_MAX_BITS)/(1<<ADC_MAX_BITS); //Gains are per 10-bit count
+  state.Kp[index] = p/scale;
+  state.Ki[index] = i/scale;
+  state.Kd[index] = d/scale;
+  state.tolerance[index] = tolerance*scale;
+  state.position[index] = state.lastPosition[index] = robAxis.getEncoderPosition();
+  state.setpoint[index] = state.position[index]; //Hold current position until told otherwise
+  state.integral[index] = 0;
+}
+
+void Robot::enableMotors(){
+  for(uint8_t i=0;i<ROBOT_AXES;i++){
+    if(!axes[i]) continue;
+    axes[i]->enable();
+    state.flags[i] |= AXIS_ENABLED;
+  }
+}
+
+void Robot::disableMotors(){
+  for(uint8_t i=0;i<ROBOT_AXES;i++){
+    state.flags[i] &= ~AXIS_ENABLED;
+    if(axes[i]) axes[i]->disable();
+  }
+}
+
+void Robot::getCurrentPose(int pose[ROBOT_AXES]){
+  for(uint8_t i=0;i<ROBOT_AXES;i++)
+    pose[i] = (int)state.position[i];
+}
+
+void Robot::getTargetPose(int pose[ROBOT_AXES]){
+  for(uint8_t i=0;i<ROBOT_AXES;i++)
+    pose[i] = (int)state.setpoint[i];
+}
+
+void Robot::setTargetPose(const int pose[ROBOT_AXES]){
+  for(uint8_t i=0;i<ROBOT_AXES;i++)
+    state.setpoint[i] = pose[i];
+}
+
+bool Robot::isMoving(){
+  return moving;
+}
+
+// One servo tick: sample every encoder, run the control law over all axes,
+// then hand the outputs to the motors.
+void Robot::tick(float dt){
+  for(uint8_t i=0;i<ROBOT_AXES;i++){
+    if(!axes[i]) continue;
+    axes[i]->updatePosition();
+    state.position[i] = axes[i]->getEncoderPosition();
+  }
+
+  state.compute(dt);
+
+  moving = false;
+  for(uint8_t i=0;i<ROBOT_AXES;i++){
+    if(!axes[i] || !(state.flags[i] & AXIS_ENABLED)) continue;
+    if(state.flags[i] & AXIS_MOVING){
+      axes[i]->rotate(axes[i]->getMaxSpeed(),-state.output[i]);
+      moving = true;
+    }else{
+      axes[i]->rotate(axes[i]->getMaxSpeed(),0.0);
+    }
+  }
+} //end of tick
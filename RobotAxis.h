@@ -4,10 +4,35 @@
 #include "teensystep4.h"  // Library for fast, asynchronous stepper motor control on Teensy4
 //using namespace TS4;      // Namespace for TeensyStep4
 #include "ArduPID.h"
+#include "SensorTrace.h"  // Input hooks for trace record/replay
+#include "Tasks.h"        // Cooperative tasks for long-running operations
+#include "AnalogInput.h"  // Encoder sampling: resolution, averaging, oversampling
+#include <EEPROM.h>       // Library for storing/recalling data from onboard EEPROM
+
+#define CALIBRATION_MAGIC 0x4B38 // Marks an EEPROM calibration record as written
+#define BACKLASH_COUNTS   8      // Encoder travel (10-bit counts) that counts as "output moved" while measuring backlash
+#define BACKLASH_SAMPLES  32     // Encoder reads averaged per backlash measurement window
+#define BACKLASH_SLOW     0.05   // Speed override for the low-load backlash measurement
+#define BACKLASH_FAST     0.5    // Speed override for the loaded (wind-up) backlash measurement
+#define BACKLASH_TAKEUP   0.5    // Minimum speed override while crossing the backlash gap after a reversal
+#define HOME_TIMEOUT_MS   30000  // Give up homing if a home sensor edge has not come in this long
+
 namespace TS4{
+    // Calibration as stored in EEPROM, one record per axis. Only the gearbox
+    // model is kept; stops and home are found again by homing at power-up.
+    struct AxisCalibration{
+      uint16_t magic;
+      uint8_t encoderBits; // Encoder resolution stepsPerCount was measured at
+      float stepsPerCount; // Motor steps per encoder count through the gearbox
+      int8_t encoderSign;  // +1 if the encoder counts up as the motor steps up, -1 if down
+      float backlash;      // Lost motion on reversal with the gearbox unloaded [steps]
+      float compliance;    // Additional wind-up per unit of speed override [steps]
+    };
+
     class RobotAxis{
       private:
         Stepper motor;
+        AnalogChannel encoder;
         int encoderPin;
         int endstopPin;
         int homingPin;
@@ -32,16 +57,30 @@ namespace TS4{
         int homeWidth;
         bool calibrated; //Home/End/Encoder sensors agree after a calibration routine
         bool enabled; //Drive is allowed to run by safety circuit
-        bool moving; //Drive is currently moving
+        bool rotating; //Motor is in rotateAsync() mode, set only by the motor helpers below
+        double motorOverride; //Last speed override sent to the motor, set only by overrideMotor()
         bool fault; // Axis indicates fault on one or more parameters
         uint8_t faultCode; //Code indicating current [highest priority] fault
+        float stepsPerCount; //Motor steps per encoder count, measured by calibrateBacklash()
+        int8_t encoderSign; //+1 if the encoder counts up as the motor steps up, -1 if down
+        float backlash; //Lost motion on reversal with the gearbox unloaded [steps]
+        float compliance; //Additional gearbox wind-up per unit of speed override [steps]
+        bool compensate; //Apply backlash feed-forward in rotate()
+        double outputSteps; //Gearbox output position in motor steps, motor position less the play
+        double lastOverride; //Last speed override passed to rotate()
+        void updateBacklash();
+        void sampleEngaged(double &counts, double &steps);
+        // Every motor command goes through these so isMoving() matches the motor
+        void rotateMotor(int speed);
+        void overrideMotor(double override);
+        void stopMotor();
 
 
 
 
       public:
-        Bounce homeSensor;
-        Bounce endStop;
+        TracedBounce homeSensor;
+        TracedBounce endStop;
         RobotAxis();
         RobotAxis(int encoderPin, 
             int endstopPin, 
@@ -54,8 +93,15 @@ namespace TS4{
             double Kp,double Ki, double Kd); //constructor
 
         void setPinModes();        // This could just happen during object initialization, should never change at runtime
+        void configureEncoder(uint8_t bits, uint8_t hwAveraging, uint8_t extraBits); // ADC resolution, hardware averaging, oversampling bits
+        uint16_t getEncoderMaximum();
+        int32_t scaleCounts(int32_t referenceCounts); // 10-bit counts to this encoder's counts
   //     void calibrateSensors();  // Run a physical calibration routine, running the axis to its endstops, recording positions
-        void calibrateHomeSensor();
+        void calibrateHomeSensor(); // Blocking, runs HomeTask to completion
+        bool calibrateBacklash();  // Blocking, runs BacklashTask to completion; false if an endstop was hit
+        bool loadCalibration(int address); // Gearbox model from EEPROM; false if none stored
+        void saveCalibration(int address);
+        bool restoreState(int savedPosition, int32_t savedSteps, bool wasCalibrated, int tolerance);
         void updatePosition();
         double getHomeOffset();
         double getPosition();
@@ -65,6 +111,15 @@ namespace TS4{
         int getHomeWidth();
         int getHardTop();
         int getHardBottom();
+        int getMaxSpeed();
+        float getBacklash();
+        float getCompliance();
+        float getStepsPerCount();
+        int8_t getEncoderSign();
+        double getOutputSteps();
+        void setBacklash(float lostMotion, float windup);
+        void setBacklashCompensation(bool enable);
+        void getTunings(double &p, double &i, double &d);
         bool isCalibrated();
         bool isEnabled();
         bool isFaulted();
@@ -78,6 +133,49 @@ namespace TS4{
         void setTargetPosition(int target,int speed);
         void rotate(uint16_t speed, double override);    //use an enumerated type for direction
         void tick();
+
+        // calibrateHomeSensor() as a task, add to a Scheduler to home without blocking
+        class HomeTask : public Task{
+          private:
+            RobotAxis& axis;
+            int homeTop;
+          public:
+            HomeTask(RobotAxis& robAxis) : axis(robAxis) {homeTop = 0;}
+            bool run() override;
+        };
+
+        // Backlash and wind-up identification: drive out and back at a slow
+        // and a fast speed, comparing motor steps with encoder travel
+        class BacklashTask : public Task{
+          private:
+            RobotAxis& axis;
+            uint8_t pass;        // 0: slow, 1: fast
+            float lost[2];       // Lost motion measured on each pass [steps]
+            double countsA,stepsA,countsB,stepsB,countsC,stepsC;
+            int start;           // Encoder count the current leg is measured from
+            int travel;          // BACKLASH_COUNTS at this encoder's resolution
+            int direction;       // Encoder direction of the outward leg
+            int8_t progress;     // 0 moving, 1 leg done, -1 stopped on an endstop
+            bool identified;
+            bool travelled(int counts, bool reverse);
+          public:
+            BacklashTask(RobotAxis& robAxis) : axis(robAxis) {identified = false;}
+            bool run() override;
+            bool isIdentified() {return identified;} // Last run finished without hitting an endstop
+        };
+
+        // Full calibration: home, identify the gearbox, then store the result
+        // at an EEPROM address and turn on compensation
+        class CalibrateTask : public Task{
+          private:
+            RobotAxis& axis;
+            HomeTask home;
+            BacklashTask gearbox;
+            int address;
+          public:
+            CalibrateTask(RobotAxis& robAxis, int eepromAddress) : axis(robAxis), home(robAxis), gearbox(robAxis) {address = eepromAddress;}
+            bool run() override;
+        };
     };//end of RobotAxis class
 
     RobotAxis::RobotAxis(int encPin, 
@@ -90,7 +188,7 @@ namespace TS4{
             int rxPin,
             double p,
             double i,
-            double d) {
+            double d) : encoder(encPin) {
 
           encoderPin = encPin;
           endstopPin = endPin;
@@ -109,17 +207,25 @@ namespace TS4{
           motor.setMaxSpeed(maximumSpeed);
           motor.setAcceleration(25000);
         // TS4::begin(); //Begin TeensyStep4 Service
-          homeSensor = Bounce();
+          homeSensor = TracedBounce();
           homeSensor.attach(homingPin,INPUT);
           homeSensor.interval(25);
-          endStop = Bounce();
+          endStop = TracedBounce();
           endStop.attach(endstopPin,INPUT_PULLUP);
           endStop.interval(25);
           calibrated = false;
-          moving = false;
+          rotating = false;
+          motorOverride = 1.0; //TeensyStep4 default
           fault = true;
           enabled = false;
           faultCode = 7; //Not Calibrated
+          stepsPerCount = 0;
+          encoderSign = 1;
+          backlash = 0;
+          compliance = 0;
+          compensate = false;
+          outputSteps = 0;
+          lastOverride = 0;
           //Check EEPROM for Hard or Soft Stop Stored Positions
           //If valid, clear fault and change faultCode to 6 for "Unverified Calibration" 
           positionController.begin(&input,                // input
@@ -261,37 +367,206 @@ namespace TS4{
     } // end of calibrateSensors
   */
     void RobotAxis::calibrateHomeSensor(){
-      endStop.update();
-      if(endStop.read()){
-        homeSensor.update();
-        if(!homeSensor.read()){
-          updatePosition();
-          motor.rotateAsync(homingSpeed);
-          if(position>0){
-            motor.overrideSpeed(1.0/10);
+      HomeTask task(*this);
+      while(task.run());
+    }
+
+    bool RobotAxis::HomeTask::run(){
+      TASK_BEGIN();
+      axis.endStop.update();
+      if(axis.endStop.read()){
+        axis.homeSensor.update();
+        if(!axis.homeSensor.read()){
+          axis.updatePosition();
+          axis.rotateMotor(axis.homingSpeed);
+          if(axis.position>0){
+            axis.overrideMotor(1.0/10);
           }else{
-            motor.overrideSpeed(-1.0/10);
+            axis.overrideMotor(-1.0/10);
           }
-          homeSensor.update();
-          while(!homeSensor.read()){
-            homeSensor.update();
+          TASK_AWAIT_TIMEOUT((axis.homeSensor.update(), axis.homeSensor.read()),HOME_TIMEOUT_MS);
+          if(!timedOut){
+            axis.updatePosition();
+            homeTop = axis.position;
+            TASK_AWAIT_TIMEOUT((axis.homeSensor.update(), !axis.homeSensor.read()),HOME_TIMEOUT_MS);
           }
-          updatePosition();
-          double hometop = position;
-          homeSensor.update();
-          while(homeSensor.read()){
-            homeSensor.update();
+          axis.stopMotor();
+          if(timedOut){
+            Serial.println("Homing Timed Out! Home Sensor Not Found");
+          }else{
+            axis.updatePosition();
+            axis.targetPosition = abs(homeTop-axis.position)/2;
+            axis.calibrated = true; //Both home edges seen, clear "Not Calibrated"
+            axis.fault = false;
+            axis.faultCode = 0;
           }
-          motor.stop();
-          double homebottom = position;
-          targetPosition = (int)abs(hometop-homebottom)/2;
         }
       }
+      axis.updatePosition();
+      TASK_END();
+    }
+
+    bool RobotAxis::calibrateBacklash(){
+      BacklashTask task(*this);
+      while(task.run());
+      return task.isIdentified();
+    }
+
+    // Average encoder counts and motor steps over a short window of reads
+    void RobotAxis::sampleEngaged(double &counts, double &steps){
+      counts = 0;
+      steps = 0;
+      for(int i=0;i<BACKLASH_SAMPLES;i++){
+        updatePosition();
+        counts += position;
+        steps += stepPosition;
+      }
+      counts /= BACKLASH_SAMPLES;
+      steps /= BACKLASH_SAMPLES;
+    }
+
+    // One read toward the end of a leg. Forward legs end counts from start;
+    // on the reverse leg start follows the furthest point reached, so the leg
+    // ends once the output has clearly come back. Stops the motor on an endstop.
+    bool RobotAxis::BacklashTask::travelled(int counts, bool reverse){
+      axis.updatePosition();
+      axis.endStop.update();
+      if(!axis.endStop.read()){
+        axis.overrideMotor(0.0);
+        progress = -1;
+        return true;
+      }
+      if(reverse){
+        if(direction*(axis.position-start)>0) start = axis.position;
+        progress = direction*(start-axis.position)>=counts;
+      }else{
+        progress = abs(axis.position-start)>=counts;
+      }
+      return progress!=0;
+    }
+
+    // While the gear train is engaged, motor steps less encoder travel (in
+    // steps) is constant; the jump in that offset across a reversal is the lost
+    // motion. Averaged windows keep encoder noise out of it. Lost motion at the
+    // slow speed is mostly backlash, the extra at the fast speed is wind-up.
+    bool RobotAxis::BacklashTask::run(){
+      TASK_BEGIN();
+      identified = false;
+      travel = axis.encoder.scale(BACKLASH_COUNTS);
+      for(pass=0;pass<2;pass++){
+        axis.updatePosition();
+        start = axis.position;
+        axis.rotateMotor(axis.homingSpeed);
+        axis.overrideMotor(pass ? BACKLASH_FAST : BACKLASH_SLOW);
+        TASK_AWAIT(travelled(2*travel,false)); //Take up the gap
+        if(progress<0) break;
+        axis.sampleEngaged(countsA,stepsA);
+        start = countsA;
+        TASK_AWAIT(travelled(4*travel,false)); //Measure the gear ratio over clean travel
+        if(progress<0) break;
+        axis.sampleEngaged(countsB,stepsB);
+        direction = countsB>countsA ? 1 : -1;
+        axis.encoderSign = (stepsB>stepsA) == (countsB>countsA) ? 1 : -1;
+        axis.stepsPerCount = fabs(stepsB-stepsA)/fabs(countsB-countsA);
+        start = axis.position;
+        axis.overrideMotor(pass ? -BACKLASH_FAST : -BACKLASH_SLOW);
+        TASK_AWAIT(travelled(2*travel,true)); //Reverse until the output has clearly moved back
+        if(progress<0) break;
+        axis.sampleEngaged(countsC,stepsC);
+        axis.overrideMotor(0.0);
+        //Offsets in motor steps; the motor led the output on the outward leg
+        lost[pass] = axis.encoderSign*direction*((stepsB-axis.encoderSign*countsB*axis.stepsPerCount)
+                                                -(stepsC-axis.encoderSign*countsC*axis.stepsPerCount));
+        if(lost[pass]<0) lost[pass] = 0;
+      }
+      if(pass==2){
+        axis.compliance = (lost[1]-lost[0])/(BACKLASH_FAST-BACKLASH_SLOW);
+        if(axis.compliance<0) axis.compliance = 0;
+        axis.backlash = lost[0] - axis.compliance*BACKLASH_SLOW;
+        if(axis.backlash<0) axis.backlash = 0;
+        axis.updatePosition();
+        axis.outputSteps = axis.stepPosition;
+        identified = true;
+      }
+      TASK_END();
+    }
+
+    bool RobotAxis::CalibrateTask::run(){
+      TASK_BEGIN();
+      home.restart();
+      gearbox.restart();
+      TASK_AWAIT(!home.run());
+      TASK_AWAIT(!gearbox.run());
+      if(gearbox.isIdentified()){
+        axis.saveCalibration(address);
+        axis.setBacklashCompensation(true);
+        Serial.print("Gearbox Calibration Saved, Backlash: ");
+        Serial.print(axis.backlash);
+        Serial.print(" Compliance: ");
+        Serial.println(axis.compliance);
+      }else{
+        Serial.println("Gearbox Calibration Stopped on Endstop! Not Saved");
+      }
+      TASK_END();
+    }
+
+    bool RobotAxis::loadCalibration(int address){
+      AxisCalibration cal;
+      EEPROM.get(address,cal);
+      if(cal.magic != CALIBRATION_MAGIC)
+        return false;
+      int shift = encoder.getBits()-cal.encoderBits; //Stored at another resolution, rescale counts
+      double ratio = shift>=0 ? (double)(1L<<shift) : 1.0/(1L<<-shift);
+      stepsPerCount = cal.stepsPerCount/ratio;
+      encoderSign = cal.encoderSign<0 ? -1 : 1;
+      backlash = cal.backlash;
+      compliance = cal.compliance;
+      return true; //Stops and home are not stored, the axis stays uncalibrated until homed
+    }
+
+    void RobotAxis::saveCalibration(int address){
+      AxisCalibration cal;
+      cal.magic = CALIBRATION_MAGIC;
+      cal.encoderBits = encoder.getBits();
+      cal.stepsPerCount = stepsPerCount;
+      cal.encoderSign = encoderSign;
+      cal.backlash = backlash;
+      cal.compliance = compliance;
+      EEPROM.put(address,cal);
+    }
+
+    // Re-arm the axis from a pre-reset snapshot if the encoder shows it has not
+    // moved since; the step counter picks up where it was. False if it moved.
+    bool RobotAxis::restoreState(int savedPosition, int32_t savedSteps, bool wasCalibrated, int tolerance){
       updatePosition();
-      
+      int moved = position-savedPosition;
+      if(abs(moved)>tolerance)
+        return false;
+      motor.setPosition(savedSteps + (int32_t)lround(encoderSign*moved*stepsPerCount));
+      updatePosition();
+      outputSteps = stepPosition;
+      if(wasCalibrated){
+        calibrated = true;
+        fault = false;
+        faultCode = 0;
+      }
+      return true;
+    }
+
+    void RobotAxis::configureEncoder(uint8_t bits, uint8_t hwAveraging, uint8_t extraBits){
+      encoder.configure(bits,hwAveraging,extraBits);
     }
+
+    uint16_t RobotAxis::getEncoderMaximum(){
+      return encoder.getMaximum();
+    }
+
+    int32_t RobotAxis::scaleCounts(int32_t referenceCounts){
+      return encoder.scale(referenceCounts);
+    }
+
     double RobotAxis::getHomeOffset(){
-      return ((homePosition*360.0)/1023)-180;
+      return ((homePosition*360.0)/encoder.getMaximum())-180;
     }
 
     double RobotAxis::getPosition(){
@@ -325,6 +600,46 @@ namespace TS4{
       return hardBottom;
     }
 
+    int RobotAxis::getMaxSpeed(){
+      return maximumSpeed;
+    }
+
+    void RobotAxis::getTunings(double &p, double &i, double &d){
+      p = Kp;
+      i = Ki;
+      d = Kd;
+    }
+
+    float RobotAxis::getBacklash(){
+      return backlash;
+    }
+
+    float RobotAxis::getCompliance(){
+      return compliance;
+    }
+
+    int8_t RobotAxis::getEncoderSign(){
+      return encoderSign;
+    }
+
+    float RobotAxis::getStepsPerCount(){
+      return stepsPerCount;
+    }
+
+    double RobotAxis::getOutputSteps(){
+      return outputSteps;
+    }
+
+    void RobotAxis::setBacklash(float lostMotion, float windup){
+      backlash = lostMotion;
+      compliance = windup;
+    }
+
+    void RobotAxis::setBacklashCompensation(bool enable){
+      compensate = enable;
+      outputSteps = motor.getPosition();
+    }
+
     bool RobotAxis::isCalibrated(){
       return calibrated;
     }
@@ -337,8 +652,24 @@ namespace TS4{
       return fault;
     }
 
+    // Commanded motion: rotating with a non-zero override
     bool RobotAxis::isMoving(){
-      return moving;
+      return rotating && motorOverride!=0;
+    }
+
+    void RobotAxis::rotateMotor(int speed){
+      rotating = true;
+      motor.rotateAsync(speed);
+    }
+
+    void RobotAxis::overrideMotor(double override){
+      motorOverride = override;
+      motor.overrideSpeed(override);
+    }
+
+    void RobotAxis::stopMotor(){
+      rotating = false;
+      motor.stop();
     }
 
     uint8_t RobotAxis::getFault(){
@@ -359,7 +690,7 @@ namespace TS4{
     void RobotAxis::disable(){
       enabled = false;
       //Serial.println("DisablingAxis");
-      motor.overrideSpeed(0.0);
+      overrideMotor(0.0);
       return;
     }
 
@@ -377,13 +708,32 @@ namespace TS4{
     }
 
     void RobotAxis::updatePosition(){
-          position = analogRead(encoderPin);
+          position = encoder.read();
           stepPosition = motor.getPosition();
-          degrees = ((position*360.0)/1023)-180;
+          updateBacklash();
+          degrees = ((position*360.0)/encoder.getMaximum())-180;
     }
+    // Play model of the gearbox: the output only follows once the motor has
+    // crossed the backlash gap, which widens with wind-up at higher speed.
+    void RobotAxis::updateBacklash(){
+      double halfPlay = (backlash + compliance*fabs(lastOverride))/2;
+      double m = motor.getPosition();
+      if(m-outputSteps>halfPlay) outputSteps = m-halfPlay;
+      else if(outputSteps-m>halfPlay) outputSteps = m+halfPlay;
+    }
+
     void RobotAxis::rotate(uint16_t speed,double override){
-      motor.rotateAsync(speed);
-      motor.overrideSpeed(override); //Scale motor to axis 
+      lastOverride = override;
+      if(compensate){ //Feed-forward: cross the gap quickly after a reversal instead of letting the PID wind up
+        updateBacklash();
+        double halfPlay = (backlash + compliance*fabs(override))/2;
+        int direction = (override>0)-(override<0);
+        double engaged = direction*(motor.getPosition()-outputSteps);
+        if(direction!=0 && engaged<halfPlay-0.5 && fabs(override)<BACKLASH_TAKEUP)
+          override = direction*BACKLASH_TAKEUP;
+      }
+      rotateMotor(speed);
+      overrideMotor(override); //Scale motor to axis 
     }
     /*void RobotAxis::tick(){
       updatePosition();
@@ -0,0 +1,189 @@
+#pragma once
+#include "Arduino.h"
+#include <Bounce2.h>      // Library for debouncing inputs
+
+// Deterministic record of every raw input the controller reads, so a session
+// on the robot can be replayed through the same control code on a PC.
+// Every analogRead()/digitalRead() made through the hooks below is stored as
+// one 8 byte event in a statically allocated buffer. The servo tick drops a
+// TRACE_TICK mark as it starts, so replay re-runs the session tick by tick;
+// reads made by tasks between two ticks belong to the earlier one. Serial
+// command bytes are recorded as TRACE_COMMAND so replay can act on them at
+// the same point.
+// The buffer holds about a second of servo ticks. For longer sessions pass a
+// stream to begin() and every event is written out as it happens instead;
+// the header then carries TRACE_STREAMED and the events run to end of file.
+// begin() re-reads the initial level of every attached TracedBounce so replay
+// starts from the levels the robot saw, not from whatever the pins read
+// during static construction.
+
+#ifndef TRACE_CAPACITY
+#define TRACE_CAPACITY 8192 // Events held in RAM (8 bytes each)
+#endif
+
+#define TRACE_MAGIC   0x54524C4B // "KLRT" little-endian
+#define TRACE_VERSION 3
+#define TRACE_STREAMED 0xFFFFFFFF // TraceHeader::count when events run to end of file
+
+enum traceKind : uint8_t {TRACE_TICK, TRACE_ANALOG, TRACE_DIGITAL, TRACE_COMMAND};
+
+struct TraceEvent{
+  uint32_t time;  // micros() when the input was read
+  uint8_t  kind;  // traceKind
+  uint8_t  pin;   // Arduino pin number (0 for TRACE_TICK and TRACE_COMMAND)
+  uint16_t value; // Raw ADC count, pin level or command byte
+};
+
+struct TraceHeader{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t eventSize;
+  uint32_t count;   // Events that follow the header, or TRACE_STREAMED
+  uint32_t dropped; // Events lost after the buffer filled
+};
+
+class SensorTrace{
+  private:
+    TraceEvent events[TRACE_CAPACITY];
+    uint32_t count;
+    uint32_t dropped;
+    bool recording;
+    Print* stream;  // Live output, nullptr to buffer
+    void writeHeader(Print& out, uint32_t events);
+  public:
+    SensorTrace();
+    void begin(Print* out = nullptr); // Clear the buffer and start recording, or stream to out
+    void end();     // Stop recording, keep the buffer for dump()
+    void record(traceKind kind, uint8_t pin, uint16_t value);
+    void mark();    // Start of a servo tick
+    void command(char c); // Serial command byte the sketch acted on
+    bool isRecording() {return recording;}
+    uint32_t size() {return count;}
+    uint32_t getDropped() {return dropped;}
+    void dump(Print& out); // Write header and events as raw binary
+};//end of SensorTrace class
+
+SensorTrace* activeTrace = nullptr; // Recorder the input hooks write to, if any
+
+SensorTrace::SensorTrace() {
+  count = 0;
+  dropped = 0;
+  recording = false;
+  stream = nullptr;
+} //end of constructor
+
+void SensorTrace::end(){
+  recording = false;
+  if(activeTrace == this)
+    activeTrace = nullptr;
+}
+
+void SensorTrace::record(traceKind kind, uint8_t pin, uint16_t value){
+  if(!recording) return;
+  TraceEvent e;
+  e.time = micros();
+  e.kind = kind;
+  e.pin = pin;
+  e.value = value;
+  if(stream){
+    stream->write((const uint8_t*)&e,sizeof(e));
+    count++;
+    return;
+  }
+  if(count >= TRACE_CAPACITY){
+    dropped++;
+    return;
+  }
+  events[count++] = e;
+}
+
+void SensorTrace::mark(){
+  record(TRACE_TICK,0,0);
+}
+
+void SensorTrace::command(char c){
+  record(TRACE_COMMAND,0,(uint8_t)c);
+}
+
+void SensorTrace::writeHeader(Print& out, uint32_t events){
+  TraceHeader header;
+  header.magic = TRACE_MAGIC;
+  header.version = TRACE_VERSION;
+  header.eventSize = sizeof(TraceEvent);
+  header.count = events;
+  header.dropped = dropped;
+  out.write((const uint8_t*)&header,sizeof(header));
+}
+
+void SensorTrace::dump(Print& out){
+  if(stream) return; //Already sent
+  writeHeader(out,count);
+  out.write((const uint8_t*)events,count*sizeof(TraceEvent));
+}
+
+// Input hooks, use these instead of analogRead()/digitalRead() for anything
+// the control code acts on.
+uint16_t traceAnalogRead(uint8_t pin){
+  uint16_t value = analogRead(pin);
+  if(activeTrace) activeTrace->record(TRACE_ANALOG,pin,value);
+  return value;
+}
+
+bool traceDigitalRead(uint8_t pin){
+  bool value = digitalRead(pin);
+  if(activeTrace) activeTrace->record(TRACE_DIGITAL,pin,value);
+  return value;
+}
+
+// Bounce that records the raw pin level every time it samples it. Every
+// instance is on a list so SensorTrace::begin() can re-read the attached ones.
+class TracedBounce : public Bounce{
+  private:
+    TracedBounce* nextTraced;
+    bool attached;
+    static TracedBounce* firstTraced;
+    void link() {nextTraced = firstTraced; firstTraced = this;}
+    void unlink();
+  protected:
+    bool readCurrentState() override {return traceDigitalRead(pin);}
+  public:
+    TracedBounce() {attached = false; link();}
+    TracedBounce(const TracedBounce& other) : Bounce(other) {attached = other.attached; link();}
+    TracedBounce& operator=(const TracedBounce& other); // Copies the debouncer, keeps this one's place on the list
+    ~TracedBounce() {unlink();}
+    void attach(int pin, int mode) {Bounce::attach(pin,mode); attached = true;}
+    void attach(int pin) {Bounce::attach(pin); attached = true;}
+    static void beginAll(); // Re-read the initial level of every attached instance
+};//end of TracedBounce class
+
+TracedBounce* TracedBounce::firstTraced = nullptr;
+
+void TracedBounce::unlink(){
+  for(TracedBounce** p = &firstTraced; *p; p = &(*p)->nextTraced){
+    if(*p != this) continue;
+    *p = nextTraced;
+    return;
+  }
+}
+
+TracedBounce& TracedBounce::operator=(const TracedBounce& other){
+  Bounce::operator=(other);
+  attached = other.attached;
+  return *this;
+}
+
+void TracedBounce::beginAll(){
+  for(TracedBounce* b = firstTraced; b; b = b->nextTraced)
+    if(b->attached) b->begin();
+}
+
+void SensorTrace::begin(Print* out){
+  count = 0;
+  dropped = 0;
+  stream = out;
+  recording = true;
+  activeTrace = this;
+  if(stream)
+    writeHeader(*stream,TRACE_STREAMED);
+  TracedBounce::beginAll(); //Initial debounced levels are part of the trace
+}
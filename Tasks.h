@@ -0,0 +1,165 @@
+#pragma once
+#include "Arduino.h"
+#include <Bounce2.h>      // Library for debouncing inputs
+
+// Cooperative, stackless tasks (protothreads) for long-running operations
+// like calibration and homing, so they read as straight-line code without
+// blocking the servo tick. A task is an object with a run() method written
+// between TASK_BEGIN() and TASK_END(); each call resumes where it last
+// waited and returns true while the task still has work to do.
+//
+// Locals do not survive a wait, keep anything needed across one as a member.
+// The wait macros are switch cases, so they cannot be used inside a switch.
+// Needs __COUNTER__ (GCC, Clang).
+//
+//    bool run() override {
+//      TASK_BEGIN();
+//      motor.rotateAsync(speed);
+//      TASK_AWAIT_HIGH(homeSensor);
+//      motor.stop();
+//      TASK_DELAY(100);
+//      TASK_END();
+//    }
+
+#define MAX_TASKS 8 // Tasks a Scheduler can hold at once
+
+class Task{
+  protected:
+    uint16_t resume;     // Resume point, 0 = start
+    uint32_t waitStart;  // millis() when the current timed wait began
+    bool timedOut;       // Last TASK_AWAIT_TIMEOUT() gave up
+  public:
+    Task() {resume = 0; waitStart = 0; timedOut = false;}
+    virtual bool run() = 0;        // Resume; false once finished
+    void restart() {resume = 0;}
+    bool isStarted() {return resume != 0;}
+};//end of Task class
+
+// Every wait gets its own resume point from __COUNTER__, the _AT forms take
+// it as an argument so the same number lands in both places. Running into a
+// resume point from the code above it is intended, hence the fallthrough.
+#define TASK_YIELD_AT(n)        do{ resume = n; return true; case n:; }while(0)
+#define TASK_AWAIT_AT(cond,n)   do{ resume = n; __attribute__((fallthrough)); case n: if(!(cond)) return true; }while(0)
+
+#define TASK_BEGIN()     switch(resume){ case 0:
+#define TASK_END()       } resume = 0; return false;
+#define TASK_YIELD()     TASK_YIELD_AT(__COUNTER__+1)
+#define TASK_AWAIT(cond) TASK_AWAIT_AT(cond,__COUNTER__+1)
+#define TASK_DELAY(ms)   do{ waitStart = millis(); TASK_AWAIT(millis()-waitStart >= (uint32_t)(ms)); }while(0)
+// Wait for cond or ms milliseconds, whichever comes first; timedOut says which
+#define TASK_AWAIT_TIMEOUT(cond,ms) do{ timedOut = false; waitStart = millis(); \
+          TASK_AWAIT((cond) || (timedOut = (millis()-waitStart >= (uint32_t)(ms)))); }while(0)
+// Debounced inputs, the Bounce object is updated while waiting
+#define TASK_AWAIT_HIGH(bounce) TASK_AWAIT(((bounce).update(), (bounce).read()))
+#define TASK_AWAIT_LOW(bounce)  TASK_AWAIT(((bounce).update(), !(bounce).read()))
+#define TASK_AWAIT_ROSE(bounce) TASK_AWAIT(((bounce).update(), (bounce).rose()))
+#define TASK_AWAIT_FELL(bounce) TASK_AWAIT(((bounce).update(), (bounce).fell()))
+// Anything with isMoving(), e.g. RobotAxis or Robot
+#define TASK_AWAIT_MOTION(drive) TASK_AWAIT(!(drive).isMoving())
+
+// Runs the servo tick at a fixed rate and resumes each task once per pass.
+// The servo is checked between every task step, so it is only ever late by
+// the longest single step of one task, never by a whole operation.
+class Scheduler{
+  private:
+    Task* tasks[MAX_TASKS];
+    uint8_t count;
+    uint8_t nextTask;      // Task runNext() steps
+    void (*servo)();
+    uint32_t servoPeriod;  // [us]
+    uint32_t nextServo;    // micros() the next tick is due
+    uint32_t servoLate;    // Longest tick delay seen [us]
+    uint32_t overruns;     // Ticks that were a whole period or more late
+    void serviceServo();
+  public:
+    Scheduler();
+    void setServo(void (*tick)(), uint32_t periodUs);
+    bool add(Task& task);  // Start task from the beginning; false if full
+    void remove(Task& task);
+    bool isRunning(Task& task);
+    void run();            // One pass, call from loop()
+    bool runNext();        // Step the next task without the servo; true once a pass is done (trace replay)
+    uint32_t getServoLate() {return servoLate;}
+    uint32_t getOverruns() {return overruns;}
+};//end of Scheduler class
+
+Scheduler::Scheduler() {
+  count = 0;
+  nextTask = 0;
+  servo = nullptr;
+  servoPeriod = 0;
+  nextServo = 0;
+  servoLate = 0;
+  overruns = 0;
+} //end of constructor
+
+void Scheduler::setServo(void (*tick)(), uint32_t periodUs){
+  servo = tick;
+  servoPeriod = periodUs;
+  nextServo = micros();
+}
+
+bool Scheduler::add(Task& task){
+  if(isRunning(task)){
+    task.restart();
+    return true;
+  }
+  if(count >= MAX_TASKS)
+    return false;
+  task.restart();
+  tasks[count++] = &task;
+  return true;
+}
+
+void Scheduler::remove(Task& task){
+  for(uint8_t i=0;i<count;i++){
+    if(tasks[i] != &task) continue;
+    for(uint8_t j=i+1;j<count;j++)
+      tasks[j-1] = tasks[j];
+    count--;
+    if(i < nextTask) nextTask--;
+    return;
+  }
+}
+
+bool Scheduler::isRunning(Task& task){
+  for(uint8_t i=0;i<count;i++)
+    if(tasks[i] == &task) return true;
+  return false;
+}
+
+void Scheduler::serviceServo(){
+  if(!servo) return;
+  uint32_t late = micros()-nextServo;
+  if((int32_t)late < 0) return;
+  if(late > servoLate) servoLate = late;
+  if(late >= servoPeriod){ //Missed at least one whole tick, resynchronize rather than burst
+    overruns++;
+    nextServo = micros();
+  }
+  nextServo += servoPeriod;
+  servo();
+}
+
+// The servo can fire between any two task steps, so a replayed tick has to
+// resume the pass where the recorded one left off rather than start over.
+bool Scheduler::runNext(){
+  if(nextTask < count){
+    Task* task = tasks[nextTask];
+    if(task->run()) nextTask++;
+    else remove(*task);
+  }
+  if(nextTask < count) return false;
+  nextTask = 0;
+  return true;
+}
+
+void Scheduler::run(){
+  serviceServo();
+  for(uint8_t i=0;i<count;){
+    Task* task = tasks[i];
+    if(task->run()) i++;
+    else remove(*task);
+    serviceServo();
+  }
+}
@@ -0,0 +1,116 @@
+#pragma once
+// Simulated axis for host benchmarks: stepper -> split-ring planetary gearbox
+// (backlash plus speed-dependent wind-up) -> analog output encoder.
+// Plants register with the mock pins: every analogRead()/digitalRead() costs
+// sampleTime of simulated time and integrates every plant over it, so the
+// blocking calibration loops in RobotAxis run against the model unchanged.
+#include "Arduino.h"
+#include "teensystep4.h"
+#include <vector>
+
+class AxisPlant{
+  private:
+    uint32_t noiseState;
+    float noiseSample(); // Uniform in [-1,1], repeatable run to run
+    static std::vector<AxisPlant*> plants;
+    static uint16_t analogSource(uint8_t pin);
+    static uint8_t digitalSource(uint8_t pin);
+    static void onMotor(TS4::Stepper& motor, TS4::motorCommand cmd, double value);
+  public:
+    int encoderPin;
+    int stepPin;
+    float stepsPerCount;  // Motor steps per encoder count through the gearbox
+    float backlash;       // True lost motion with the gearbox unloaded [steps]
+    float compliance;     // True wind-up per unit speed override [steps]
+    float noise;          // Encoder noise amplitude [counts]
+    float countOffset;    // Encoder count at output position 0
+    uint8_t bits;         // Encoder resolution, counts run 0..2^bits-1
+    int direction;        // -1 if the encoder counts down as the motor steps up
+    double output;        // True gearbox output position [steps]
+    TS4::Stepper* motor;  // Bound on the first command sent to stepPin
+
+    AxisPlant(int encPin, int stpPin);
+    void integrate(double dt);
+    uint16_t encoderCount();
+
+    static uint32_t sampleTime;  // Simulated cost of one pin read [us]
+    static void attach(AxisPlant& plant);
+    static void detach();
+    static void run(uint32_t us); // Advance simulated time with no reads
+};//end of AxisPlant class
+
+std::vector<AxisPlant*> AxisPlant::plants;
+uint32_t AxisPlant::sampleTime = 10;
+
+AxisPlant::AxisPlant(int encPin, int stpPin) {
+  encoderPin = encPin;
+  stepPin = stpPin;
+  stepsPerCount = 20;
+  backlash = 0;
+  compliance = 0;
+  noise = 0;
+  countOffset = 512;
+  bits = 10;
+  direction = 1;
+  output = 0;
+  motor = nullptr;
+  noiseState = 0x12345678u ^ (uint32_t)encPin;
+} //end of constructor
+
+float AxisPlant::noiseSample(){
+  noiseState = noiseState*1664525u + 1013904223u;
+  return (noiseState>>8)/8388607.5f - 1.0f;
+}
+
+void AxisPlant::integrate(double dt){
+  if(!motor) return;
+  motor->simulate(dt);
+  double load = motor->running ? fabs(motor->factor) : 0;
+  double halfPlay = (backlash + compliance*load)/2;
+  if(motor->position-output>halfPlay) output = motor->position-halfPlay;
+  else if(output-motor->position>halfPlay) output = motor->position+halfPlay;
+}
+
+uint16_t AxisPlant::encoderCount(){
+  double count = direction*output/stepsPerCount + countOffset + noise*noiseSample();
+  long rounded = lround(count);
+  long maximum = (1L<<bits)-1;
+  return rounded<0 ? 0 : (rounded>maximum ? maximum : rounded);
+}
+
+void AxisPlant::attach(AxisPlant& plant){
+  plants.push_back(&plant);
+  mock::analogSource = analogSource;
+  mock::digitalSource = digitalSource;
+  TS4::onMotorCommand = onMotor;
+}
+
+void AxisPlant::detach(){
+  plants.clear();
+  mock::analogSource = nullptr;
+  mock::digitalSource = nullptr;
+  TS4::onMotorCommand = nullptr;
+}
+
+void AxisPlant::run(uint32_t us){
+  mock::advance(us);
+  for(AxisPlant* p : plants)
+    p->integrate(us*1e-6);
+}
+
+uint16_t AxisPlant::analogSource(uint8_t pin){
+  run(sampleTime);
+  for(AxisPlant* p : plants)
+    if(p->encoderPin == pin) return p->encoderCount();
+  return mock::analogPins[pin];
+}
+
+uint8_t AxisPlant::digitalSource(uint8_t pin){
+  run(sampleTime);
+  return mock::digitalPins[pin];
+}
+
+void AxisPlant::onMotor(TS4::Stepper& motor, TS4::motorCommand, double){
+  for(AxisPlant* p : plants)
+    if(p->stepPin == motor.stepPin) p->motor = &motor;
+}
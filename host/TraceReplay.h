@@ -0,0 +1,201 @@
+#pragma once
+// Feeds a SensorTrace recording back through the mock Arduino inputs.
+// Each servo tick, with the task steps that followed it, gets exactly the
+// analogRead()/digitalRead() values the robot saw in that span, in the order
+// it read them, and the mock clock jumps to the recorded time of each read so
+// Bounce and ArduPID timing match. Recorded serial commands are handed back
+// in order with those reads.
+#include "Arduino.h"
+#include "SensorTrace.h"
+#include <vector>
+
+class TraceReplay{
+  private:
+    struct PinQueue{
+      std::vector<TraceEvent> events;
+      size_t next = 0;
+      uint16_t last = 0;
+      bool seen = false; // First read sets the level, it is not an edge
+    };
+    std::vector<TraceEvent> events;
+    size_t cursor;
+    uint32_t passTime;
+    PinQueue analogQueue[256];
+    PinQueue digitalQueue[256];
+    PinQueue commandQueue;
+    uint32_t passes;
+    uint32_t underruns;  // Reads with nothing recorded, code asked for more than the robot did
+    uint32_t unread;     // Recorded reads the code never made
+    uint32_t dropped;    // Events the recorder lost when its buffer filled
+    uint32_t edgeTime;   // Time of the first unanswered digital edge
+    bool edgePending;
+    static TraceReplay* current;
+
+    uint16_t serve(PinQueue& q, bool digital);
+    bool earliestPending(uint32_t& time);
+    static uint16_t analogSource(uint8_t pin) {return current->serve(current->analogQueue[pin],false);}
+    static uint8_t digitalSource(uint8_t pin) {return current->serve(current->digitalQueue[pin],true);}
+  public:
+    TraceReplay();
+    bool load(const char* path);
+    void attach();      // Route mock analogRead()/digitalRead() through this replay
+    void detach();
+    bool nextPass();    // Queue the reads for the next servo tick, false at end of trace
+    size_t pending();   // Reads queued for this tick and not made yet
+    bool skipToPending(); // Move the clock to the next read not made yet; false if none
+    bool nextCommand(char& command); // Next command recorded before any pending read, clock moved to it
+    uint32_t getPassTime() {return passTime;}
+    uint32_t getPasses() {return passes;}
+    uint32_t getUnderruns() {return underruns;}
+    uint32_t getUnread() {return unread;}
+    uint32_t getDropped() {return dropped;}
+    size_t size() {return events.size();}
+    // Time since the oldest digital edge no output has reacted to yet;
+    // returns false if there is none. Clears the pending edge.
+    bool takeEdgeLatency(uint32_t& latency);
+};//end of TraceReplay class
+
+TraceReplay* TraceReplay::current = nullptr;
+
+TraceReplay::TraceReplay() {
+  cursor = 0;
+  passTime = 0;
+  passes = 0;
+  underruns = 0;
+  unread = 0;
+  dropped = 0;
+  edgeTime = 0;
+  edgePending = false;
+} //end of constructor
+
+bool TraceReplay::load(const char* path){
+  FILE* f = std::fopen(path,"rb");
+  if(!f){
+    std::fprintf(stderr,"replay: cannot open %s\n",path);
+    return false;
+  }
+  TraceHeader header;
+  bool ok = std::fread(&header,sizeof(header),1,f) == 1
+         && header.magic == TRACE_MAGIC
+         && header.version == TRACE_VERSION
+         && header.eventSize == sizeof(TraceEvent);
+  if(ok && header.count == TRACE_STREAMED){ //Streamed live, events run to end of file
+    TraceEvent e;
+    while(std::fread(&e,sizeof(e),1,f) == 1)
+      events.push_back(e);
+    dropped = 0;
+  }else if(ok){
+    events.resize(header.count);
+    ok = std::fread(events.data(),sizeof(TraceEvent),header.count,f) == header.count;
+    dropped = header.dropped;
+  }
+  std::fclose(f);
+  if(!ok)
+    std::fprintf(stderr,"replay: %s is not a version %d trace\n",path,TRACE_VERSION);
+  return ok;
+}
+
+void TraceReplay::attach(){
+  current = this;
+  mock::analogSource = analogSource;
+  mock::digitalSource = digitalSource;
+}
+
+void TraceReplay::detach(){
+  mock::analogSource = nullptr;
+  mock::digitalSource = nullptr;
+  if(current == this)
+    current = nullptr;
+}
+
+bool TraceReplay::nextPass(){
+  if(cursor >= events.size() && passes > 0)
+    return false;
+  for(int pin=0;pin<256;pin++){
+    PinQueue* queues[2] = {&analogQueue[pin],&digitalQueue[pin]};
+    for(PinQueue* q : queues){
+      unread += q->events.size()-q->next;
+      q->events.clear();
+      q->next = 0;
+    }
+  }
+  unread += commandQueue.events.size()-commandQueue.next;
+  commandQueue.events.clear();
+  commandQueue.next = 0;
+  if(cursor < events.size())
+    passTime = events[cursor].time;
+  if(cursor < events.size() && events[cursor].kind == TRACE_TICK)
+    cursor++;
+  while(cursor < events.size() && events[cursor].kind != TRACE_TICK){
+    const TraceEvent& e = events[cursor++];
+    if(e.kind == TRACE_ANALOG) analogQueue[e.pin].events.push_back(e);
+    else if(e.kind == TRACE_DIGITAL) digitalQueue[e.pin].events.push_back(e);
+    else if(e.kind == TRACE_COMMAND) commandQueue.events.push_back(e);
+  }
+  mock::now = passTime;
+  passes++;
+  return true;
+}
+
+size_t TraceReplay::pending(){
+  size_t count = 0;
+  for(int pin=0;pin<256;pin++)
+    count += analogQueue[pin].events.size()-analogQueue[pin].next
+           + digitalQueue[pin].events.size()-digitalQueue[pin].next;
+  return count;
+}
+
+bool TraceReplay::earliestPending(uint32_t& time){
+  bool found = false;
+  for(int pin=0;pin<256;pin++){
+    PinQueue* queues[2] = {&analogQueue[pin],&digitalQueue[pin]};
+    for(PinQueue* q : queues){
+      if(q->next >= q->events.size()) continue;
+      uint32_t t = q->events[q->next].time;
+      if(!found || (int32_t)(t-time) < 0) time = t;
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool TraceReplay::skipToPending(){
+  uint32_t earliest = 0;
+  if(!earliestPending(earliest)) return false;
+  mock::now = earliest;
+  return true;
+}
+
+bool TraceReplay::nextCommand(char& command){
+  if(commandQueue.next >= commandQueue.events.size()) return false;
+  const TraceEvent& e = commandQueue.events[commandQueue.next];
+  uint32_t earliest = 0;
+  if(earliestPending(earliest) && (int32_t)(e.time-earliest) > 0) return false;
+  commandQueue.next++;
+  mock::now = e.time;
+  command = (char)e.value;
+  return true;
+}
+
+uint16_t TraceReplay::serve(PinQueue& q, bool digital){
+  if(q.next >= q.events.size()){
+    underruns++;
+    return q.last;
+  }
+  const TraceEvent& e = q.events[q.next++];
+  mock::now = e.time;
+  if(digital && q.seen && e.value != q.last && !edgePending){
+    edgeTime = e.time;
+    edgePending = true;
+  }
+  q.last = e.value;
+  q.seen = true;
+  return e.value;
+}
+
+bool TraceReplay::takeEdgeLatency(uint32_t& latency){
+  if(!edgePending) return false;
+  latency = mock::now - edgeTime;
+  edgePending = false;
+  return true;
+}
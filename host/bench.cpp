@@ -0,0 +1,238 @@
+// Host benchmarks for the controller, built against the mocks in host/mock.
+// Micro: the calls made every servo tick. Macro: the Robot closed loop
+// driving simulated axes along a trajectory, reporting tick rate and
+// tracking error. Simulated results are deterministic, only the timings
+// depend on the machine.
+//
+//    cmake --build <dir> --target bench   (repetitions, median, JSON in <dir>/bench.json)
+#include <benchmark/benchmark.h>
+#include "Robot.h"
+#include "AxisPlant.h"
+#include <random>
+
+#define TICK_US 1000 // Servo tick [us]
+
+// Encoder, endstop, home, enable, dir, step for five axes
+static const int axisPins[ROBOT_AXES][6] = {
+  {14,2,3,4,5,6}, {19,8,10,9,12,7}, {40,31,11,35,33,34}, {41,39,39,38,36,37}, {24,25,26,27,28,29}
+};
+
+static RobotAxis makeAxis(int i){
+  mock::digitalPins[axisPins[i][1]] = HIGH; //Endstop open (pull-up)
+  return RobotAxis(axisPins[i][0],axisPins[i][1],axisPins[i][2],axisPins[i][3],axisPins[i][4],axisPins[i][5],
+                   0,1,0.022,0,0.0001);
+}
+
+// ----------------------------------------------------------------- micro
+
+static void BM_UpdatePosition(benchmark::State& state){
+  RobotAxis axis = makeAxis(2);
+  uint16_t count = 0;
+  for(auto _ : state){
+    mock::analogPins[40] = (count++) & 1023;
+    axis.updatePosition();
+    benchmark::DoNotOptimize(axis.getPosition());
+  }
+}
+BENCHMARK(BM_UpdatePosition);
+
+// Arg 0: stick centred (axis disabled), 1: stick deflected (axis driven)
+static void BM_JoyStickRotate(benchmark::State& state){
+  RobotAxis axis = makeAxis(2);
+  JoyStick stick(21,22,23,20);
+  mock::analogPins[21] = 512;
+  stick.setHome();
+  mock::analogPins[21] = state.range(0) ? 800 : 520;
+  for(auto _ : state)
+    stick.rotate(X,axis,9000);
+}
+BENCHMARK(BM_JoyStickRotate)->Arg(0)->Arg(1);
+
+// Stand-in ArduPID from host/mock, one compute() per sample period
+static void BM_PIDCompute(benchmark::State& state){
+  double input = 0, output = 0, setpoint = 700;
+  ArduPID pid;
+  pid.begin(&input,&output,&setpoint,0.022,0.001,0.0001);
+  pid.setSampleTime(1);
+  pid.setOutputLimits(-1,1);
+  pid.start();
+  for(auto _ : state){
+    mock::advance(TICK_US);
+    input += output;
+    pid.compute();
+    benchmark::DoNotOptimize(output);
+  }
+}
+BENCHMARK(BM_PIDCompute);
+
+// Robot's per-field control pass, cost per tick as the axis count grows
+template <uint8_t N>
+static void BM_AxisStateCompute(benchmark::State& state){
+  static AxisState<N> axes;
+  axes.clear();
+  for(uint8_t i=0;i<N;i++){
+    axes.Kp[i] = 0.022f;
+    axes.Kd[i] = 0.0001f;
+    axes.setpoint[i] = 700;
+    axes.tolerance[i] = 2;
+    axes.flags[i] = AXIS_ENABLED;
+  }
+  float position = 0;
+  for(auto _ : state){
+    for(uint8_t i=0;i<N;i++)
+      axes.position[i] = position + i;
+    position += 0.5f;
+    axes.compute(TICK_US*1e-6f);
+    benchmark::DoNotOptimize(axes.output);
+  }
+  state.SetItemsProcessed(state.iterations()*N);
+}
+BENCHMARK_TEMPLATE(BM_AxisStateCompute,1);
+BENCHMARK_TEMPLATE(BM_AxisStateCompute,2);
+BENCHMARK_TEMPLATE(BM_AxisStateCompute,4);
+BENCHMARK_TEMPLATE(BM_AxisStateCompute,8);
+BENCHMARK_TEMPLATE(BM_AxisStateCompute,16);
+BENCHMARK_TEMPLATE(BM_AxisStateCompute,32);
+BENCHMARK_TEMPLATE(BM_AxisStateCompute,64);
+
+// Full Robot::tick: encoder reads, control pass, motor commands
+static void BM_RobotTick(benchmark::State& state){
+  RobotAxis axes[ROBOT_AXES] = {makeAxis(0),makeAxis(1),makeAxis(2),makeAxis(3),makeAxis(4)};
+  JoyStick stick(21,22,23,20);
+  Robot robot(stick);
+  for(int i=0;i<ROBOT_AXES;i++)
+    robot.attachAxis(i,axes[i]);
+  int target[ROBOT_AXES] = {700,600,500,400,300};
+  robot.setTargetPose(target);
+  robot.enableMotors();
+  for(auto _ : state){
+    for(int i=0;i<ROBOT_AXES;i++)
+      mock::analogPins[axisPins[i][0]]++;
+    robot.tick(TICK_US*1e-6f);
+  }
+  state.SetItemsProcessed(state.iterations()*ROBOT_AXES);
+}
+BENCHMARK(BM_RobotTick);
+
+// Encoder noise floor against sampling setup. The ADC model quantizes a
+// noisy input at mock::adcResolution and averages mock::adcAveraging
+// conversions like the Teensy's hardware averaging; the input ramps slowly so
+// quantization error is spread evenly. Args: ADC bits, hardware averaging,
+// oversampling bits. Counters: noise (standard deviation of the read error)
+// in channel counts and degrees, effective bits, and modelled read time, over
+// a fixed ENCODER_SAMPLES reads so the table is the same on every machine.
+#define ADC_NOISE_LSB 0.5     // Analog noise, standard deviation [10-bit counts]
+#define ADC_CALL_US   0.3     // Modelled analogRead() overhead [us]
+#define ADC_CONV_US(bits) (0.35+0.03*(bits)) // Modelled conversion time [us]
+#define ENCODER_SAMPLES 100000 // Reads per setup
+
+static double adcInput;      // True input, fraction of full scale
+static double adcBusyUs;     // Modelled ADC time spent so far
+static std::mt19937 adcRng;
+
+static uint16_t adcModel(uint8_t){
+  std::normal_distribution<double> noise(0,ADC_NOISE_LSB/1024);
+  const uint32_t full = 1UL<<mock::adcResolution;
+  uint32_t sum = 0;
+  for(uint8_t i=0;i<mock::adcAveraging;i++){
+    long code = (long)floor((adcInput+noise(adcRng))*full);
+    sum += code<0 ? 0 : (code>=(long)full ? full-1 : code);
+  }
+  adcBusyUs += ADC_CALL_US + mock::adcAveraging*ADC_CONV_US(mock::adcResolution);
+  return sum/mock::adcAveraging;
+}
+
+static void BM_EncoderSampling(benchmark::State& state){
+  AnalogChannel channel(40);
+  channel.configure(state.range(0),state.range(1),state.range(2));
+  const double full = channel.getMaximum()+1.0;
+  adcRng.seed(1);
+  adcBusyUs = 0;
+  mock::analogSource = adcModel;
+  double sum = 0, sumSq = 0;
+  int64_t reads = 0;
+  for(auto _ : state){
+    adcInput = 0.25 + 0.5*((reads*7919)%100003)/100003.0;
+    double error = channel.read() - adcInput*full;
+    sum += error;
+    sumSq += error*error;
+    reads++;
+  }
+  mock::analogSource = nullptr;
+  double mean = sum/reads;
+  double sigma = sqrt(sumSq/reads - mean*mean);
+  state.counters["noise"] = sigma;
+  state.counters["noise_deg"] = sigma*360/full;
+  state.counters["enob"] = log2(full/(sigma*sqrt(12.0)));
+  state.counters["us/read"] = adcBusyUs/reads;
+}
+BENCHMARK(BM_EncoderSampling)->ArgNames({"bits","avg","os"})
+  ->Args({10,1,0})->Args({10,4,0})->Args({12,1,0})->Args({12,4,0})
+  ->Args({12,32,0})->Args({12,4,1})->Args({12,4,2})->Iterations(ENCODER_SAMPLES);
+
+// ----------------------------------------------------------------- macro
+
+// Robot tracking a sine on every axis through simulated gearboxes for
+// Arg seconds of robot time. Counters: simulated ticks per wall-clock second
+// and tracking error (setpoint vs true output) in encoder counts, measured
+// after the first second.
+static void BM_ClosedLoop(benchmark::State& state){
+  const int seconds = state.range(0);
+  const int ticks = seconds*1000000/TICK_US;
+  double rms = 0, worst = 0;
+  for(auto _ : state){
+    state.PauseTiming();
+    mock::now = 0;
+    RobotAxis axes[ROBOT_AXES] = {makeAxis(0),makeAxis(1),makeAxis(2),makeAxis(3),makeAxis(4)};
+    AxisPlant* plants[ROBOT_AXES];
+    AxisPlant::sampleTime = 0;
+    for(int i=0;i<ROBOT_AXES;i++){
+      plants[i] = new AxisPlant(axisPins[i][0],axisPins[i][5]);
+      plants[i]->direction = -1; //Motor and encoder run opposite ways on the arm
+      plants[i]->backlash = 20;
+      plants[i]->compliance = 10;
+      plants[i]->noise = 0.6;
+      AxisPlant::attach(*plants[i]);
+    }
+    JoyStick stick(21,22,23,20);
+    Robot robot(stick);
+    for(int i=0;i<ROBOT_AXES;i++)
+      robot.attachAxis(i,axes[i]);
+    robot.enableMotors();
+    state.ResumeTiming();
+
+    double sumSq = 0;
+    int samples = 0;
+    worst = 0;
+    int target[ROBOT_AXES];
+    for(int tick=0;tick<ticks;tick++){
+      double t = tick*TICK_US*1e-6;
+      for(int i=0;i<ROBOT_AXES;i++)
+        target[i] = 512 + lround(150*sin(2*M_PI*0.2*t + i));
+      robot.setTargetPose(target);
+      robot.tick(TICK_US*1e-6f);
+      AxisPlant::run(TICK_US);
+      if(t < 1) continue;
+      for(int i=0;i<ROBOT_AXES;i++){
+        double actual = plants[i]->direction*plants[i]->output/plants[i]->stepsPerCount + plants[i]->countOffset;
+        double error = fabs(target[i]-actual);
+        sumSq += error*error;
+        samples++;
+        if(error > worst) worst = error;
+      }
+    }
+
+    state.PauseTiming();
+    rms = sqrt(sumSq/samples);
+    AxisPlant::detach();
+    for(int i=0;i<ROBOT_AXES;i++)
+      delete plants[i];
+    state.ResumeTiming();
+  }
+  state.counters["ticks/s"] = benchmark::Counter((double)ticks*state.iterations(),benchmark::Counter::kIsRate);
+  state.counters["rms_err"] = rms;
+  state.counters["max_err"] = worst;
+}
+BENCHMARK(BM_ClosedLoop)->Arg(10)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,149 @@
+// Backlash identification and compensation benchmark on a simulated axis.
+// Identifies backlash/wind-up with RobotAxis::calibrateBacklash(), with the
+// encoder counting up and counting down as the motor steps up, then runs the
+// axis the way the firmware does, closed on the encoder through Robot::tick(),
+// with the rotate() takeup off and on. Reports tracking error on a sine and,
+// for point-to-point moves approached from alternating sides, where the
+// gearbox output actually ended up (mean arrival from each side relative to
+// the overall mean, their difference and the spread, in motor steps) and how
+// long each move took to settle within the Robot's tolerance.
+//
+// usage: klr_bench_backlash [moves]
+#include "Robot.h"
+#include "AxisPlant.h"
+using namespace TS4;
+
+#define AXIS 2
+#define ENC 40
+#define END 31
+#define HOM 11
+#define STP 34
+
+#define TICK_US      1000  // Servo tick [us]
+#define TARGET       512   // Positioning target [counts]
+#define APPROACH     40    // Start this far either side of the target [counts]
+#define MOVE_TICKS   1500  // Ticks allowed per move
+#define SETTLED      2     // Within this of the target counts as arrived [counts]
+
+struct Arrivals{
+  int count;
+  double sum,sumSq;
+  void add(double v) {count++; sum += v; sumSq += v*v;}
+  double mean() {return count ? sum/count : 0;}
+  double stddev() {double m = mean(); return count ? sqrt(sumSq/count-m*m) : 0;}
+};
+
+static void setPlant(AxisPlant& plant, int direction){
+  plant.stepsPerCount = 20;
+  plant.backlash = 60;
+  plant.compliance = 40;
+  plant.noise = 0.6;
+  plant.direction = direction;
+}
+
+// True output position in encoder counts
+static double outputCounts(AxisPlant& plant){
+  return plant.direction*plant.output/plant.stepsPerCount + plant.countOffset;
+}
+
+static void hold(Robot& robot, int target){
+  int pose[ROBOT_AXES] = {0};
+  pose[AXIS] = target;
+  robot.setTargetPose(pose);
+}
+
+// Ticks until the output stays within SETTLED of target for the rest of the move
+static int move(Robot& robot, AxisPlant& plant, int target){
+  hold(robot,target);
+  int settled = MOVE_TICKS;
+  for(int tick=0;tick<MOVE_TICKS;tick++){
+    robot.tick(TICK_US*1e-6f);
+    AxisPlant::run(TICK_US);
+    if(fabs(outputCounts(plant)-target) > SETTLED) settled = MOVE_TICKS;
+    else if(settled == MOVE_TICKS) settled = tick;
+  }
+  return settled;
+}
+
+int main(int argc, char** argv){
+  int moves = argc > 1 ? atoi(argv[1]) : 50;
+  mock::digitalPins[END] = HIGH; // Endstop open (pull-up)
+  mock::digitalPins[HOM] = LOW;
+
+  std::printf("%-14s %10s %10s %10s\n","parameter","true","enc up","enc down");
+  float identified[2][4];
+  for(int reversed=0;reversed<=1;reversed++){
+    RobotAxis probe(ENC,END,HOM,35,33,STP,34,35,0,0,0);
+    AxisPlant trial(ENC,STP);
+    setPlant(trial,reversed ? -1 : 1);
+    AxisPlant::attach(trial);
+    if(!probe.calibrateBacklash()){
+      std::printf("calibration hit an endstop\n");
+      return 1;
+    }
+    AxisPlant::detach();
+    identified[reversed][0] = probe.getStepsPerCount();
+    identified[reversed][1] = probe.getBacklash();
+    identified[reversed][2] = probe.getCompliance();
+    identified[reversed][3] = probe.getEncoderSign();
+  }
+  AxisPlant reference(ENC,STP);
+  setPlant(reference,1);
+  std::printf("%-14s %10.2f %10.2f %10.2f\n","steps/count",reference.stepsPerCount,identified[0][0],identified[1][0]);
+  std::printf("%-14s %10.2f %10.2f %10.2f\n","backlash",reference.backlash,identified[0][1],identified[1][1]);
+  std::printf("%-14s %10.2f %10.2f %10.2f\n","compliance",reference.compliance,identified[0][2],identified[1][2]);
+  std::printf("%-14s %10s %10.0f %10.0f\n","encoder sign","",identified[0][3],identified[1][3]);
+  std::printf("\n");
+
+  // Robot::tick() drives the motor with -output, so the arm's encoder runs
+  // opposite to the motor
+  std::printf("Robot::tick, encoder counting down\n");
+  std::printf("%-8s %9s %9s %9s %9s %11s %9s %9s\n","takeup","rms err","max err",
+              "above","below","hysteresis","stddev","settle ms");
+  for(int takeup=0;takeup<=1;takeup++){
+    mock::now = 0;
+    RobotAxis axis(ENC,END,HOM,35,33,STP,34,35,0.022,0,0.0001);
+    AxisPlant plant(ENC,STP);
+    setPlant(plant,-1);
+    AxisPlant::sampleTime = 10; // Calibration waits on millis(), reads advance the clock
+    AxisPlant::attach(plant);
+    axis.calibrateBacklash();
+    axis.setBacklashCompensation(takeup);
+    AxisPlant::sampleTime = 0; // The tick loop below advances the clock itself
+    JoyStick stick(21,22,23,20);
+    Robot robot(stick);
+    robot.attachAxis(AXIS,axis);
+    robot.enableMotors();
+
+    double sumSq = 0, worst = 0;
+    int samples = 0;
+    const double start = plant.direction*plant.output/plant.stepsPerCount+plant.countOffset;
+    for(int tick=0;tick<10000;tick++){ // 10 s of a 0.2 Hz sine, scored after the first second
+      double t = tick*TICK_US*1e-6;
+      int target = lround(start + 40*sin(2*M_PI*0.2*t));
+      hold(robot,target);
+      robot.tick(TICK_US*1e-6f);
+      AxisPlant::run(TICK_US);
+      if(t < 1) continue;
+      double error = fabs(target-outputCounts(plant));
+      sumSq += error*error;
+      samples++;
+      if(error > worst) worst = error;
+    }
+
+    Arrivals above = {}, below = {}, all = {}, settle = {};
+    for(int n=0;n<moves;n++){
+      bool fromAbove = n%2;
+      move(robot,plant,TARGET+(fromAbove ? APPROACH : -APPROACH));
+      settle.add(move(robot,plant,TARGET));
+      double arrival = plant.output; // Same target every time, any spread is lost motion
+      (fromAbove ? above : below).add(arrival);
+      all.add(arrival);
+    }
+    AxisPlant::detach();
+    std::printf("%-8s %9.2f %9.2f %9.2f %9.2f %11.2f %9.2f %9.1f\n",takeup ? "on" : "off",
+                sqrt(sumSq/samples),worst,above.mean()-all.mean(),below.mean()-all.mean(),
+                above.mean()-below.mean(),all.stddev(),settle.mean()*TICK_US/1000);
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+// Host stand-in for ArduPID: parallel PID with output clamping and a fixed
+// sample time, the subset of the library RobotAxis uses.
+#include "Arduino.h"
+
+class ArduPID{
+  private:
+    double *input = nullptr, *output = nullptr, *setpoint = nullptr;
+    double kp = 0, ki = 0, kd = 0;
+    double outMin = 0, outMax = 255;
+    double iTerm = 0, lastInput = 0;
+    uint32_t sampleTime = 100; // ms
+    uint32_t lastTime = 0;
+    bool running = false;
+  public:
+    void begin(double* in, double* out, double* set, double p, double i, double d){
+      input = in; output = out; setpoint = set;
+      setCoefficients(p,i,d);
+      lastInput = *input;
+      lastTime = millis();
+    }
+    void setCoefficients(double p, double i, double d) {kp = p; ki = i; kd = d;}
+    void setSampleTime(uint32_t ms) {sampleTime = ms;}
+    void setOutputLimits(double low, double high) {outMin = low; outMax = high;}
+    void start() {running = true;}
+    void stop() {running = false;}
+    void reset() {iTerm = 0; lastInput = *input;}
+    void compute(){
+      if(!running) return;
+      uint32_t now = millis();
+      if(now - lastTime < sampleTime) return;
+      double dt = (now - lastTime)/1000.0;
+      double error = *setpoint - *input;
+      iTerm += ki*error*dt;
+      iTerm = iTerm > outMax ? outMax : (iTerm < outMin ? outMin : iTerm);
+      double out = kp*error + iTerm - kd*(*input - lastInput)/dt;
+      *output = out > outMax ? outMax : (out < outMin ? outMin : out);
+      lastInput = *input;
+      lastTime = now;
+    }
+};
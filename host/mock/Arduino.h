@@ -0,0 +1,80 @@
+#pragma once
+// Host stand-in for the Teensy core. Just enough of Arduino.h to compile the
+// controller headers on a PC; pin levels, ADC counts and the clock live in
+// namespace mock so replay and simulation code can drive them.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+using std::abs;
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+#define LOW          0
+#define HIGH         1
+#define DMAMEM       // RAM2 placement on the Teensy
+
+namespace mock{
+  inline uint32_t now = 0;            // micros()
+  inline uint16_t analogPins[256];    // analogRead() values
+  inline uint8_t  digitalPins[256];   // digitalRead()/digitalWrite() levels
+  // Optional overrides, e.g. a trace replay feeding recorded values
+  inline uint16_t (*analogSource)(uint8_t pin) = nullptr;
+  inline uint8_t  (*digitalSource)(uint8_t pin) = nullptr;
+  inline bool     serialEcho = false; // Print Serial output to stdout
+  inline const char* serialInput = nullptr; // Bytes Serial.read() hands out, e.g. scripted commands
+  inline uint8_t  adcResolution = 10; // analogReadResolution()
+  inline uint8_t  adcAveraging = 4;   // analogReadAveraging()
+
+  inline void advance(uint32_t us) {now += us;}
+}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) {mock::digitalPins[pin] = value;}
+inline uint8_t digitalRead(uint8_t pin){
+  return mock::digitalSource ? mock::digitalSource(pin) : mock::digitalPins[pin];
+}
+inline int analogRead(uint8_t pin){
+  return mock::analogSource ? mock::analogSource(pin) : mock::analogPins[pin];
+}
+inline void analogReadResolution(unsigned int bits) {mock::adcResolution = bits;}
+inline void analogReadAveraging(unsigned int num) {mock::adcAveraging = num;}
+inline uint32_t micros() {return mock::now;}
+inline uint32_t millis() {return mock::now/1000;}
+inline void delay(uint32_t ms) {mock::advance(ms*1000);}
+inline void delayMicroseconds(uint32_t us) {mock::advance(us);}
+inline void arm_dcache_flush(void*, uint32_t) {}
+inline long random(long low, long high) {return low + std::rand()%(high-low);}
+inline long random(long high) {return std::rand()%high;}
+
+class Print{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size){
+      for(size_t i=0;i<size;i++) write(buffer[i]);
+      return size;
+    }
+};
+
+class HostSerial : public Print{
+  public:
+    void begin(unsigned long) {}
+    int available() {return mock::serialInput ? (int)strlen(mock::serialInput) : 0;}
+    int read() {return available() ? (uint8_t)*mock::serialInput++ : -1;}
+    size_t write(uint8_t b) override {if(mock::serialEcho) std::putchar(b); return 1;}
+    using Print::write;
+    void print(const char* s) {if(mock::serialEcho) std::fputs(s,stdout);}
+    void print(double v) {if(mock::serialEcho) std::printf("%.2f",v);}
+    void print(long v) {if(mock::serialEcho) std::printf("%ld",v);}
+    void print(int v) {print((long)v);}
+    void print(unsigned int v) {print((long)v);}
+    void print(unsigned long v) {print((long)v);}
+    template <typename T> void println(T v) {print(v); println();}
+    void println() {print("\n");}
+};
+
+inline HostSerial Serial;
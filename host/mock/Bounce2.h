@@ -0,0 +1,55 @@
+#pragma once
+// Host stand-in for Bounce2, same stable-interval algorithm as the library
+#include "Arduino.h"
+
+class Debouncer{
+  private:
+    static const uint8_t DEBOUNCED_STATE = 0b00000001;
+    static const uint8_t UNSTABLE_STATE  = 0b00000010;
+    static const uint8_t CHANGED_STATE   = 0b00000100;
+    void setStateFlag(uint8_t flag) {state |= flag;}
+    void unsetStateFlag(uint8_t flag) {state &= ~flag;}
+    void toggleStateFlag(uint8_t flag) {state ^= flag;}
+    bool getStateFlag(uint8_t flag) const {return (state & flag) != 0;}
+  protected:
+    unsigned long previous_millis = 0;
+    uint16_t interval_millis = 10;
+    uint8_t state = 0;
+    void begin(){
+      state = 0;
+      if(readCurrentState()) setStateFlag(DEBOUNCED_STATE | UNSTABLE_STATE);
+      previous_millis = millis();
+    }
+    virtual bool readCurrentState() = 0;
+  public:
+    virtual ~Debouncer() {}
+    void interval(uint16_t interval_millis) {this->interval_millis = interval_millis;}
+    bool update(){
+      unsetStateFlag(CHANGED_STATE);
+      bool currentState = readCurrentState();
+      if(currentState != getStateFlag(UNSTABLE_STATE)){
+        previous_millis = millis();
+        toggleStateFlag(UNSTABLE_STATE);
+      }else if(millis() - previous_millis >= interval_millis){
+        if(currentState != getStateFlag(DEBOUNCED_STATE)){
+          previous_millis = millis();
+          toggleStateFlag(DEBOUNCED_STATE);
+          setStateFlag(CHANGED_STATE);
+        }
+      }
+      return changed();
+    }
+    bool read() const {return getStateFlag(DEBOUNCED_STATE);}
+    bool changed() const {return getStateFlag(CHANGED_STATE);}
+    bool fell() const {return changed() && !read();}
+    bool rose() const {return changed() && read();}
+};
+
+class Bounce : public Debouncer{
+  protected:
+    uint8_t pin = 0;
+    bool readCurrentState() override {return digitalRead(pin);}
+  public:
+    void attach(int pin, int mode) {this->pin = pin; pinMode(pin,mode); begin();}
+    void attach(int pin) {this->pin = pin; begin();}
+};
@@ -0,0 +1,18 @@
+#pragma once
+// Host stand-in for the Teensy EEPROM emulation (4284 bytes on Teensy 4.1)
+#include "Arduino.h"
+
+class EEPROMClass{
+  private:
+    uint8_t data[4284];
+  public:
+    EEPROMClass() {memset(data,0xFF,sizeof(data));}
+    uint8_t read(int address) {return data[address];}
+    void write(int address, uint8_t value) {data[address] = value;}
+    void update(int address, uint8_t value) {data[address] = value;}
+    template <typename T> T& get(int address, T& value) {memcpy(&value,data+address,sizeof(T)); return value;}
+    template <typename T> const T& put(int address, const T& value) {memcpy(data+address,&value,sizeof(T)); return value;}
+    uint16_t length() {return sizeof(data);}
+};
+
+inline EEPROMClass EEPROM;
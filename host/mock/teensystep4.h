@@ -0,0 +1,42 @@
+#pragma once
+// Host stand-in for TeensyStep4. Commands are recorded rather than pulsed;
+// simulate() integrates the commanded speed so closed-loop code sees motion.
+#include "Arduino.h"
+
+namespace TS4{
+  class Stepper;
+  enum motorCommand : uint8_t {MOTOR_ROTATE, MOTOR_OVERRIDE, MOTOR_STOP, MOTOR_POSITION};
+  // Optional observer for every command sent to any motor
+  inline void (*onMotorCommand)(Stepper& motor, motorCommand cmd, double value) = nullptr;
+
+  inline void begin() {}
+
+  class Stepper{
+    private:
+      void notify(motorCommand cmd, double value) {if(onMotorCommand) onMotorCommand(*this,cmd,value);}
+    public:
+      int stepPin = -1;
+      int dirPin = -1;
+      int32_t maxSpeed = 0;
+      int32_t acceleration = 0;
+      int32_t speed = 0;        // Last rotateAsync() speed [steps/s]
+      double  factor = 1.0;     // Last overrideSpeed() factor
+      bool    running = false;
+      double  position = 0;     // Integrated step position
+
+      Stepper() {}
+      Stepper(int stepPin, int dirPin) : stepPin(stepPin), dirPin(dirPin) {}
+      Stepper& setMaxSpeed(int32_t s) {maxSpeed = s; return *this;}
+      Stepper& setAcceleration(int32_t a) {acceleration = a; return *this;}
+      void rotateAsync(int32_t s) {speed = s; running = true; notify(MOTOR_ROTATE,s);}
+      void rotateAsync() {rotateAsync(maxSpeed);}
+      void overrideSpeed(double f) {factor = f; notify(MOTOR_OVERRIDE,f);}
+      void stop() {running = false; notify(MOTOR_STOP,0);}
+      void emergencyStop() {stop();}
+      int32_t getPosition() const {return (int32_t)position;}
+      void setPosition(int32_t p) {position = p; notify(MOTOR_POSITION,p);}
+      bool isMoving() const {return running && speed*factor != 0;}
+      double velocity() const {return running ? speed*factor : 0;} // [steps/s]
+      void simulate(double dt) {position += velocity()*dt;}
+  };
+}
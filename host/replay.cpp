@@ -0,0 +1,93 @@
+// Replays a SensorTrace recording through the real sketch (main.cpp) on a PC,
+// one servoTick() per recorded tick followed by the task steps, and prints every change in commanded motor state, one line per change:
+//    <time us> step<pin> <rotate|override|stop|position> <value>
+// Diff the output of two builds to see what a control-law change does to a
+// recorded session. Summary lines start with '#'.
+//
+// usage: klr_replay <trace.bin> [--serial]
+//    --serial  also print the sketch's Serial output
+#include "main.cpp"
+#include "TraceReplay.h"
+#include <map>
+
+struct MotorSnapshot{
+  int32_t speed;
+  double factor;
+  bool running;
+};
+
+static TraceReplay replay;
+static std::map<int,MotorSnapshot> motors;
+static uint32_t latencyCount = 0;
+static uint64_t latencyTotal = 0;
+static uint32_t latencyMax = 0;
+
+static void onMotor(TS4::Stepper& motor, TS4::motorCommand cmd, double value){
+  static const char* names[] = {"rotate","override","stop","position"};
+  MotorSnapshot now = {motor.speed,motor.factor,motor.running};
+  auto last = motors.find(motor.stepPin);
+  bool changed = cmd == TS4::MOTOR_POSITION || last == motors.end()
+              || last->second.speed != now.speed
+              || last->second.factor != now.factor
+              || last->second.running != now.running;
+  motors[motor.stepPin] = now;
+  if(!changed) return;
+  std::printf("%u step%d %s %g\n",(unsigned)mock::now,motor.stepPin,names[cmd],value);
+  uint32_t latency;
+  if(replay.takeEdgeLatency(latency)){
+    latencyCount++;
+    latencyTotal += latency;
+    if(latency > latencyMax) latencyMax = latency;
+  }
+}
+
+int main(int argc, char** argv){
+  if(argc < 2){
+    std::fprintf(stderr,"usage: %s <trace.bin> [--serial]\n",argv[0]);
+    return 2;
+  }
+  mock::serialEcho = argc > 2 && strcmp(argv[2],"--serial") == 0;
+  if(!replay.load(argv[1]))
+    return 1;
+  replay.attach();
+  TS4::onMotorCommand = onMotor;
+
+  replay.nextPass(); // Reads made before the first tick belong to setup()
+  TracedBounce::beginAll(); // Initial debounced levels, recorded first by trace.begin()
+  setup();
+  uint32_t first = replay.getPassTime();
+  while(replay.nextPass()){
+    servoTick();
+    // Task steps between ticks: keep stepping while they read what the robot
+    // read, each from the time of its first read so millis() waits line up.
+    // Serial commands go in where loop() read them, before later task reads.
+    // The robot's tick can land mid-pass, the next tick carries on from there.
+    char command;
+    bool progress = false; // Some task read something this pass
+    while(true){
+      if(replay.nextCommand(command)){
+        runCommand(command);
+        continue;
+      }
+      if(!replay.skipToPending()) break;
+      size_t left = replay.pending();
+      bool passDone = scheduler.runNext();
+      progress |= replay.pending() != left;
+      if(!passDone) continue;
+      if(!progress) break;
+      progress = false;
+    }
+  }
+  replay.detach();
+
+  uint32_t ticks = replay.getPasses()-1;
+  uint32_t span = replay.getPassTime()-first;
+  std::printf("# events %u, ticks %u, dropped %u\n",(unsigned)replay.size(),(unsigned)ticks,(unsigned)replay.getDropped());
+  if(ticks > 0)
+    std::printf("# recorded tick period %.1f us\n",(double)span/ticks);
+  std::printf("# reads not in trace %u, recorded reads and commands not made %u\n",(unsigned)replay.getUnderruns(),(unsigned)replay.getUnread());
+  if(latencyCount > 0)
+    std::printf("# edge-to-command latency mean %.1f us, max %u us over %u edges\n",
+                (double)latencyTotal/latencyCount,(unsigned)latencyMax,(unsigned)latencyCount);
+  return 0;
+}
@@ -21,11 +21,16 @@
 #include "ArduPID.h"      // Library for PID motor control
 #include "teensystep4.h"  // Library for fast, asynchronous stepper motor control on Teensy4
 #include "RobotAxis.h"    //Custom Library for controlling motor/encoder and sensors as a single axis object
+#include "SensorTrace.h"  //Custom Library for recording raw sensor inputs for host-side replay
+#include "Recovery.h"     //Custom Library for watchdog and fast recovery from a reset-surviving state snapshot
+#include "Tasks.h"        //Custom Library for cooperative tasks alongside the fixed-rate servo tick
 using namespace TS4;      // Namespace for TeensyStep4
 
 // $$$$$$$$$$$ function prototypes
 void setupIO(); // Set pins to Input/Output modes and zero joystick axes
 void setupMotors(); //Enable outputs, begin TS4 and set speeds
+void servoTick(); //Fixed-rate safety checks and axis control, run by the scheduler
+void runCommand(char command); //Act on one serial command byte, also called by host replay
 
 // ################# Constant Declarations ########################
 #define JOYXPIN 21
@@ -78,6 +83,14 @@ void setupMotors(); //Enable outputs, begin TS4 and set speeds
 */
 // Generic
 #define LED 13 //Onboard Feedback Led
+#define WATCHDOG_MS 250 //Reset the controller if the scheduler stalls this long
+//#define KLR_WATCHDOG_TEST //Bench only: send 'w' over serial to stall the loop and force a watchdog reset
+#define SERVO_PERIOD_US 1000 //Servo tick period (1kHz)
+#define ENCODER_BITS 12 //ADC resolution for the axis encoders
+#define ENCODER_AVERAGING 4 //ADC hardware averaging per conversion
+#define ENCODER_OVERSAMPLE 0 //Extra bits from oversampling, costs 4^n conversions per read
+//#define KLR_TRACE //Record raw inputs from power-up, send 'd' over serial to dump the binary trace
+//#define KLR_TRACE_STREAM SerialUSB1 //With KLR_TRACE: stream the trace live instead of buffering it (USB Type "Dual Serial")
 
 
 // ************************** Variable Declarations *******************************
@@ -112,10 +125,19 @@ RobotAxis axisThree(AXIS3ENC,AXIS3END,AXIS3HOM,AXIS3EN,AXIS3DIR,AXIS3STP,34,35,K
 RobotAxis axisTwo(AXIS2ENC,AXIS2HOM,AXIS2HOM,AXIS2EN,AXIS2DIR,AXIS2STP,34,35,Kp2,Ki2,Kd2);
 RobotAxis axisFour(AXIS4ENC,AXIS4HOM,AXIS4HOM,AXIS4EN,AXIS4DIR,AXIS4STP,34,35,Kp4,Ki4,Kd4);
 JoyStick joystick(JOYXPIN,JOYYPIN,JOYZPIN,JOYBUT);
+Recovery recovery; // Watchdog and reset-surviving state snapshot
+Scheduler scheduler; // Runs servoTick() at a fixed rate alongside long-running tasks
+RobotAxis::CalibrateTask calibrateAxisThree(axisThree,3*sizeof(AxisCalibration)); // Send 'c' over serial: home, identify gearbox, save
+#ifdef KLR_TRACE
+SensorTrace trace; // Raw input recorder for host replay
+#endif
 // ()()()() Other Declarations ()()()()
 
 void setupIO(){ // Setup pin modes for I/O
   joystick.setPinModes();  
+  axisTwo.configureEncoder(ENCODER_BITS,ENCODER_AVERAGING,ENCODER_OVERSAMPLE);
+  axisThree.configureEncoder(ENCODER_BITS,ENCODER_AVERAGING,ENCODER_OVERSAMPLE);
+  axisFour.configureEncoder(ENCODER_BITS,ENCODER_AVERAGING,ENCODER_OVERSAMPLE);
 
   encoderPins[0]= AXIS3ENC; //Set to axis3 while testing
   encoderPins[1]= AXIS3ENC; //Set to axis3 while testing
@@ -161,6 +183,13 @@ uint16_t updatePosition(uint8_t axis){
 // <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<   SETUP (Run Once at Startup)  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 void setup()
 {
+#ifdef KLR_TRACE
+#ifdef KLR_TRACE_STREAM
+  trace.begin(&KLR_TRACE_STREAM); //Record every input read from here on, sent as it happens
+#else
+  trace.begin(); //Record every input read from here on
+#endif
+#endif
   estop = false; //Allow robot motion
  // mstop = true;  //Force ManualControl
   Serial.begin(115200); //Begin USB serial for debugging
@@ -170,6 +199,21 @@ void setup()
   Serial.print("...");
   setupMotors(); //Enable outputs, begin TS4 and set speeds
   Serial.println("done.");
+  // Recall stored gearbox calibration and compensate backlash if present
+  if(axisTwo.loadCalibration(2*sizeof(AxisCalibration))) axisTwo.setBacklashCompensation(true);
+  if(axisThree.loadCalibration(3*sizeof(AxisCalibration))) axisThree.setBacklashCompensation(true);
+  if(axisFour.loadCalibration(4*sizeof(AxisCalibration))) axisFour.setBacklashCompensation(true);
+  // After a watchdog or other unplanned reset, pick up from the last snapshot instead of re-homing
+  recovery.attachAxis(1,axisTwo);
+  recovery.attachAxis(2,axisThree);
+  recovery.attachAxis(3,axisFour);
+  if(recovery.restore()){
+    Serial.print("Recovered from unplanned reset #");
+    Serial.println(recovery.getResets());
+  }
+  recovery.startWatchdog(WATCHDOG_MS);
+  scheduler.setServo(servoTick,SERVO_PERIOD_US);
+  scheduler.add(recovery); //Feeds the watchdog every scheduler pass
   targetPosition = 700; //Set target position for PID axis control
   joystick.invertY();
 }
@@ -177,6 +221,41 @@ void setup()
 // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> LOOP (Run repeatedly after Setup) >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
 void loop()
 {
+  if(Serial.available()){
+    char command = Serial.read();
+#ifdef KLR_TRACE
+    trace.command(command); //Replay feeds it back through runCommand()
+#endif
+    runCommand(command);
+  }
+  scheduler.run(); //Servo tick when due, then one step of each task
+}
+
+void runCommand(char command){
+  if(command=='c' && !scheduler.isRunning(calibrateAxisThree)){
+    Serial.println("Calibrating Axis 3...");
+    scheduler.add(calibrateAxisThree);
+  }
+#ifdef KLR_WATCHDOG_TEST
+  if(command=='w'){ //Test watchdog recovery, the next boot should report a recovered reset
+    Serial.println("Stalling Until Watchdog Reset...");
+    while(true);
+  }
+#endif
+#ifdef KLR_TRACE
+  if(command=='d' && trace.isRecording()){
+    trace.end();
+    trace.dump(Serial);
+  }
+#endif
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ SERVO TICK (Run every SERVO_PERIOD_US) ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void servoTick()
+{
+#ifdef KLR_TRACE
+  trace.mark(); //Replay re-runs servoTick() once per mark
+#endif
   axisThree.endStop.update();
   //Serial.println("Next");
   if(!axisThree.endStop.read()){
@@ -194,7 +273,7 @@ void loop()
     //axisThree.tick();
   }else{
     if(mstop&&!estop){
-      joystick.rotate(X,axisThree,speed);
+      if(!scheduler.isRunning(calibrateAxisThree)) joystick.rotate(X,axisThree,speed); //Calibration has the axis
       joystick.rotate(Z,axisFour,speed);
       joystick.rotate(Y,axisTwo,speed);
 